@@ -81,7 +81,18 @@ class BaseProcgenEnv(CEnv):
         debug_mode=0,
         resource_root=None,
         num_threads=4,
+        scheduler=None,
+        spin_wait_us=-1,
+        thread_affinity=None,
+        numa_node=-1,
+        num_slots=1,
+        batch_size=0,
+        shared_pool=False,
+        pool_threads=-1,
+        pool_priority=0,
         render_mode=None,
+        render_env_ids=None,
+        render_interval=1,
     ):
         if resource_root is None:
             resource_root = os.path.join(SCRIPT_DIR, "data", "assets") + os.sep
@@ -117,12 +128,30 @@ class BaseProcgenEnv(CEnv):
                 "debug_mode": debug_mode,
                 "rand_seed": rand_seed,
                 "num_threads": num_threads,
+                "spin_wait_us": spin_wait_us,
+                "numa_node": numa_node,
+                "num_slots": num_slots,
+                "batch_size": batch_size,
+                "shared_pool": bool(shared_pool),
+                "pool_threads": pool_threads,
+                "pool_priority": pool_priority,
                 "render_human": render_human,
+                "render_human_interval": render_interval,
                 # these will only be used the first time an environment is created in a process
                 "resource_root": resource_root,
             }
         )
 
+        if scheduler is not None:
+            options["scheduler"] = scheduler
+
+        if thread_affinity is not None:
+            options["thread_affinity"] = ",".join(str(cpu) for cpu in thread_affinity)
+
+        if render_env_ids is not None:
+            assert render_human, "render_env_ids requires render_mode"
+            options["render_human_env_ids"] = ",".join(str(i) for i in render_env_ids)
+
         self.options = options
 
         super().__init__(
@@ -132,11 +161,111 @@ class BaseProcgenEnv(CEnv):
             c_func_defs=[
                 "int get_state(libenv_env *, int, char *, int);",
                 "void set_state(libenv_env *, int, char *, int);",
+                "int convert_bgr32_to_rgb888(libenv_env *, int, char *, char *, int, int);",
+                "int get_worker_cpus(libenv_env *, int *, int);",
+                "void set_slot_buffers(libenv_env *, int, struct libenv_buffers *);",
+                "void act_async(libenv_env *, int);",
+                "void wait_async(libenv_env *, int);",
+                "void send_async(libenv_env *, int32_t *, int *, int);",
+                "int recv_async(libenv_env *, int *);",
+                "void get_cost_estimates(libenv_env *, float *, float *, float *);",
             ],
         )
         # don't use the dict space for actions
         self.ac_space = self.ac_space["action"]
 
+        assert num % num_slots == 0, "num must be a multiple of num_slots"
+        assert batch_size == 0 or num_slots == 1, "batch_size can't be combined with num_slots"
+        self.num_slots = num_slots
+        self.batch_size = batch_size
+        # once games have been sent, observe() would block on them and mix up environments at different steps
+        self._sent = False
+        self._slot_bufs = []
+        if num_slots > 1 or batch_size > 0:
+            for slot in range(num_slots):
+                self._slot_bufs.append(self._make_slot_buffers(slot))
+
+    def _make_slot_buffers(self, slot):
+        # each slot gets its own observation, reward, first and action arrays, so that one slot can be
+        # read while the other slots are being stepped, info is still written to the main buffers
+        slot_num = self.num // self.num_slots
+        ob_names = self.options.get("obs_spaces", "rgb").split(",")
+        slot_bufs = {
+            "ob": {name: np.zeros((slot_num,) + self.ob_space[name].shape, dtype=np.uint8) for name in ob_names},
+            "rew": np.zeros(slot_num, dtype=np.float32),
+            "first": np.zeros(slot_num, dtype=np.uint8),
+            "ac": np.zeros(slot_num, dtype=np.int32),
+        }
+
+        # pointers are grouped by space and then by env, like libenv_set_buffers
+        ob_ptrs = [self._ffi.from_buffer(slot_bufs["ob"][name][i]) for name in ob_names for i in range(slot_num)]
+        ac_ptrs = [self._ffi.from_buffer(slot_bufs["ac"][i:i + 1]) for i in range(slot_num)]
+        c_bufs = self._ffi.new("struct libenv_buffers *")
+        c_ob = self._ffi.new("void *[]", ob_ptrs)
+        c_ac = self._ffi.new("void *[]", ac_ptrs)
+        c_bufs.ob = c_ob
+        c_bufs.ac = c_ac
+        c_bufs.info = self._ffi.NULL
+        c_bufs.rew = self._ffi.cast("float *", self._ffi.from_buffer(slot_bufs["rew"]))
+        c_bufs.first = self._ffi.cast("uint8_t *", self._ffi.from_buffer(slot_bufs["first"]))
+        self.call_c_func("set_slot_buffers", slot, c_bufs)
+
+        # the C side keeps pointers into all of these, so they have to live as long as the environment
+        slot_bufs["_keepalive"] = (c_bufs, c_ob, c_ac, ob_ptrs, ac_ptrs)
+        return slot_bufs
+
+    def act_async(self, slot, ac):
+        """
+        Start stepping the environments in a slot with the given actions and return immediately, requires num_slots > 1
+
+        Slot i holds environments i * num / num_slots through (i + 1) * num / num_slots - 1
+        """
+        np.copyto(self._slot_bufs[slot]["ac"], ac.astype(np.int32))
+        self.call_c_func("act_async", slot)
+
+    def wait_async(self, slot):
+        """
+        Wait for the environments in a slot to finish stepping and return (rew, ob, first) for them
+        """
+        self.call_c_func("wait_async", slot)
+        slot_bufs = self._slot_bufs[slot]
+        return (
+            slot_bufs["rew"].copy(),
+            {name: ob.copy() for name, ob in slot_bufs["ob"].items()},
+            slot_bufs["first"].copy(),
+        )
+
+    def send(self, ac, env_ids):
+        """
+        Start stepping the environments in env_ids with the given actions and return immediately, requires batch_size > 0
+
+        An environment can't be sent again until recv() has returned it
+        """
+        ac = np.ascontiguousarray(ac, dtype=np.int32)
+        env_ids = np.ascontiguousarray(env_ids, dtype=np.int32)
+        assert ac.shape == env_ids.shape == (len(env_ids),)
+        self._sent = True
+        self.call_c_func(
+            "send_async",
+            self._ffi.cast("int32_t *", self._ffi.from_buffer(ac)),
+            self._ffi.cast("int *", self._ffi.from_buffer(env_ids)),
+            len(env_ids),
+        )
+
+    def recv(self):
+        """
+        Wait for the first batch_size sent environments to finish stepping and return (rew, ob, first, env_ids) for them
+        """
+        env_ids = np.zeros(self.batch_size, dtype=np.int32)
+        self.call_c_func("recv_async", self._ffi.cast("int *", self._ffi.from_buffer(env_ids)))
+        slot_bufs = self._slot_bufs[0]
+        return (
+            slot_bufs["rew"][env_ids],
+            {name: ob[env_ids] for name, ob in slot_bufs["ob"].items()},
+            slot_bufs["first"][env_ids],
+            env_ids,
+        )
+
     def get_state(self):
         length = MAX_STATE_SIZE
         buf = self._ffi.new(f"char[{length}]")
@@ -152,6 +281,27 @@ class BaseProcgenEnv(CEnv):
             state = states[env_idx]
             self.call_c_func("set_state", env_idx, state, len(state))
 
+    def get_worker_cpus(self):
+        """
+        Returns the cpu each stepping thread is pinned to, or -1 for threads that aren't pinned
+        """
+        count = self.call_c_func("get_worker_cpus", self._ffi.NULL, 0)
+        cpus = self._ffi.new(f"int[{max(count, 1)}]")
+        self.call_c_func("get_worker_cpus", cpus, count)
+        return [cpus[i] for i in range(count)]
+
+    def get_cost_estimates(self):
+        """
+        Returns moving averages of how long each environment takes to step in microseconds, as a dict with
+        "step" for steps that didn't end an episode, "reset" for steps that did and "expected" for all steps
+        """
+        result = {name: np.zeros(self.num, dtype=np.float32) for name in ["step", "reset", "expected"]}
+        self.call_c_func(
+            "get_cost_estimates",
+            *[self._ffi.cast("float *", self._ffi.from_buffer(result[name])) for name in ["step", "reset", "expected"]],
+        )
+        return result
+
     def get_combos(self):
         return [
             ("LEFT", "DOWN"),
@@ -194,7 +344,14 @@ class BaseProcgenEnv(CEnv):
             result.append(action)
         return result
 
+    def observe(self):
+        if self._sent:
+            raise Exception("observe can only be used before the first send when batch_size > 0, use recv instead")
+        return super().observe()
+
     def act(self, ac):
+        if self.batch_size > 0:
+            raise Exception("act can't be used when batch_size > 0, use send instead")
         # tensorflow may return int64 actions (https://github.com/openai/gym/blob/master/gym/spaces/discrete.py#L13)
         # so always cast actions to int32
         return super().act({"action": ac.astype(np.int32)})
@@ -215,6 +372,15 @@ class ProcgenGym3Env(BaseProcgenEnv):
         use_generated_assets=False,
         paint_vel_info=False,
         distribution_mode="hard",
+        renderer="qt",
+        action_repeat=1,
+        max_pool_frames=False,
+        frame_stack=1,
+        obs_spaces=("rgb",),
+        cache_scaled_assets=True,
+        cache_static_layer=True,
+        entity_grid_min_entities=32,
+        sweep_min_entities=8,
         **kwargs,
     ):
         assert (
@@ -234,6 +400,12 @@ class ProcgenGym3Env(BaseProcgenEnv):
         else:
             distribution_mode = DISTRIBUTION_MODE_DICT[distribution_mode]
 
+        # a bare string would otherwise be joined character by character
+        if isinstance(obs_spaces, str):
+            obs_spaces = (obs_spaces,)
+        if not all(isinstance(name, str) for name in obs_spaces):
+            raise TypeError(f"obs_spaces must be a string or a sequence of strings, got {obs_spaces!r}")
+
         options = {
                 "center_agent": bool(center_agent),
                 "use_generated_assets": bool(use_generated_assets),
@@ -242,6 +414,15 @@ class ProcgenGym3Env(BaseProcgenEnv):
                 "use_backgrounds": bool(use_backgrounds),
                 "paint_vel_info": bool(paint_vel_info),
                 "distribution_mode": distribution_mode,
+                "renderer": renderer,
+                "action_repeat": action_repeat,
+                "max_pool_frames": bool(max_pool_frames),
+                "frame_stack": frame_stack,
+                "obs_spaces": ",".join(obs_spaces),
+                "cache_scaled_assets": bool(cache_scaled_assets),
+                "cache_static_layer": bool(cache_static_layer),
+                "entity_grid_min_entities": entity_grid_min_entities,
+                "sweep_min_entities": sweep_min_entities,
             }
         super().__init__(num, env_name, options, **kwargs)
         
@@ -252,13 +433,22 @@ class ToBaselinesVecEnv(gym3.ToBaselinesVecEnv):
         'video.frames_per_second' : 15
     }
     def render(self, mode="human"):
-        info = self.env.get_info()[0]
-        _, ob, _ = self.env.observe()
         if mode == "rgb_array":
-            if "rgb" in info:
-                return info["rgb"]
-            else:
-                return ob['rgb'][0]        
+            return self.get_images()[0]
+
+    def get_images(self):
+        infos = self.env.get_info()
+        if all("rgb" in info for info in infos):
+            return np.array([info["rgb"] for info in infos])
+
+        _, ob, _ = self.env.observe()
+        if "rgb" not in ob:
+            raise Exception('images require "rgb" in obs_spaces or render_mode="rgb_array"')
+        frames = ob["rgb"]
+        if frames.ndim == 5:
+            # with frame_stack the last frame is the newest one
+            frames = frames[:, -1]
+        return frames
 
 
 def ProcgenEnv(num_envs, env_name, **kwargs):
@@ -1,7 +1,8 @@
+import sys
 import numpy as np
 import pytest
 from .env import ENV_NAMES
-from procgen import ProcgenGym3Env
+from procgen import ProcgenEnv, ProcgenGym3Env
 
 
 @pytest.mark.parametrize("env_name", ["coinrun", "starpilot"])
@@ -52,6 +53,198 @@ def test_determinism(env_name):
     assert np.array_equal(obs1, obs2)
 
 
+@pytest.mark.parametrize("scheduler", ["queue", "static", "steal"])
+def test_num_threads(scheduler):
+    # the results should not depend on how the games are spread over the stepping threads
+    def collect_observations(num_threads):
+        rng = np.random.RandomState(0)
+        env = ProcgenGym3Env(num=64, env_name="bigfish", rand_seed=23, num_threads=num_threads, scheduler=scheduler)
+        rew, obs, first = env.observe()
+        result = [(rew, obs["rgb"], first)]
+        for _ in range(64):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            rew, obs, first = env.observe()
+            result.append((rew, obs["rgb"], first))
+        return result
+
+    expected = collect_observations(num_threads=0)
+    for num_threads in [1, 16]:
+        for (rew1, obs1, first1), (rew2, obs2, first2) in zip(expected, collect_observations(num_threads)):
+            assert np.array_equal(rew1, rew2)
+            assert np.array_equal(obs1, obs2)
+            assert np.array_equal(first1, first2)
+
+
+def test_steal_scheduler_stress():
+    # many short steps with games of uneven cost, a thread that is still looking for games to steal when
+    # the next step starts must not lose the games it is handed for that step
+    def collect_rewards(num_threads):
+        rng = np.random.RandomState(0)
+        env = ProcgenGym3Env(num=24, env_name="starpilot", rand_seed=5, num_threads=num_threads, scheduler="steal")
+        result = []
+        for _ in range(1000):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            rew, _obs, first = env.observe()
+            result.append((rew, first))
+        return result
+
+    expected = collect_rewards(num_threads=0)
+    for num_threads in [3, 7]:
+        for (rew1, first1), (rew2, first2) in zip(expected, collect_rewards(num_threads)):
+            assert np.array_equal(rew1, rew2)
+            assert np.array_equal(first1, first2)
+
+
+def test_cost_estimates():
+    env = ProcgenGym3Env(num=4, env_name="bigfish,caveflyer", num_threads=2)
+    for _ in range(16):
+        env.act(np.zeros(env.num, dtype=np.int32))
+    costs = env.get_cost_estimates()
+    assert costs["expected"].shape == (4,)
+    # every game has been reset at least once and stepped since
+    assert np.all(costs["reset"] > 0)
+    assert np.all(costs["expected"] > 0)
+
+
+def test_shared_pool():
+    # environments sharing the process wide pool should step the same as ones with their own threads
+    def collect_observations(**kwargs):
+        rng = np.random.RandomState(0)
+        envs = [
+            ProcgenGym3Env(num=4, env_name="bigfish", rand_seed=23, **kwargs),
+            ProcgenGym3Env(num=4, env_name="maze", rand_seed=23, pool_priority=1, **kwargs),
+        ]
+        result = []
+        for _ in range(32):
+            for env in envs:
+                env.act(rng.randint(low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32))
+            for env in envs:
+                rew, obs, first = env.observe()
+                result.append((rew, obs["rgb"], first))
+        return result
+
+    expected = collect_observations(num_threads=0)
+    # the second round reuses the threads from the first one, which keep the size the first round gave them
+    for _ in range(2):
+        for (rew1, obs1, first1), (rew2, obs2, first2) in zip(expected, collect_observations(shared_pool=True, pool_threads=2)):
+            assert np.array_equal(rew1, rew2)
+            assert np.array_equal(obs1, obs2)
+            assert np.array_equal(first1, first2)
+
+
+def test_async_slots():
+    # pipelining two slots should give the same results as stepping all environments together
+    kwargs = dict(num=8, env_name="coinrun", rand_seed=5, num_threads=2)
+    env1 = ProcgenGym3Env(**kwargs)
+    env2 = ProcgenGym3Env(num_slots=2, **kwargs)
+    rng = np.random.RandomState(0)
+    for _ in range(32):
+        rew1, obs1, first1 = env1.observe()
+        acts = rng.randint(low=0, high=env1.ac_space.eltype.n, size=(env1.num,), dtype=np.int32)
+        for slot, envs in enumerate([slice(0, 4), slice(4, 8)]):
+            rew2, obs2, first2 = env2.wait_async(slot)
+            assert np.array_equal(rew1[envs], rew2)
+            assert np.array_equal(obs1["rgb"][envs], obs2["rgb"])
+            assert np.array_equal(first1[envs], first2)
+            env2.act_async(slot, acts[envs])
+        env1.act(acts)
+
+
+def test_async_slots_mixed_with_act():
+    # act and observe should keep working on all environments when some steps are taken with act_async
+    kwargs = dict(num=8, env_name="coinrun", rand_seed=5, num_threads=2)
+    env1 = ProcgenGym3Env(**kwargs)
+    env2 = ProcgenGym3Env(num_slots=2, **kwargs)
+    rng = np.random.RandomState(0)
+    slots = [slice(0, 4), slice(4, 8)]
+    for t in range(32):
+        acts = rng.randint(low=0, high=env1.ac_space.eltype.n, size=(env1.num,), dtype=np.int32)
+        env1.act(acts)
+        if t % 3 == 0:
+            env2.act(acts)
+        else:
+            for slot, envs in enumerate(slots):
+                env2.act_async(slot, acts[envs])
+        rew1, obs1, first1 = env1.observe()
+        if t % 2 == 0:
+            rew2, obs2, first2 = env2.observe()
+            obs2 = obs2["rgb"]
+        else:
+            results = [env2.wait_async(slot) for slot in range(2)]
+            rew2 = np.concatenate([r for r, _, _ in results])
+            obs2 = np.concatenate([o["rgb"] for _, o, _ in results])
+            first2 = np.concatenate([f for _, _, f in results])
+        assert np.array_equal(rew1, rew2)
+        assert np.array_equal(obs1["rgb"], obs2)
+        assert np.array_equal(first1, first2)
+
+
+def test_send_recv():
+    # each environment should follow the same trajectory no matter which batch it comes back in
+    kwargs = dict(num=6, env_name="caveflyer", rand_seed=5, num_threads=2)
+    num_steps = 16
+    rng = np.random.RandomState(0)
+    acts = rng.randint(low=0, high=15, size=(num_steps, 6), dtype=np.int32)
+
+    env1 = ProcgenGym3Env(**kwargs)
+    expected = []
+    for t in range(num_steps):
+        env1.act(acts[t])
+        rew, obs, first = env1.observe()
+        expected.append((rew, obs["rgb"], first))
+
+    env2 = ProcgenGym3Env(batch_size=2, **kwargs)
+    with pytest.raises(Exception):
+        env2.act(acts[0])
+    env2.observe()
+    env2.send(acts[0], np.arange(6))
+    with pytest.raises(Exception):
+        env2.observe()
+    steps = np.zeros(6, dtype=np.int32)
+    for _ in range(num_steps * 6 // 2):
+        rew, obs, first, env_ids = env2.recv()
+        assert len(env_ids) == 2
+        for i, env_idx in enumerate(env_ids):
+            exp_rew, exp_obs, exp_first = expected[steps[env_idx]]
+            assert rew[i] == exp_rew[env_idx]
+            assert np.array_equal(obs["rgb"][i], exp_obs[env_idx])
+            assert first[i] == exp_first[env_idx]
+            steps[env_idx] += 1
+        send_ids = [env_idx for env_idx in env_ids if steps[env_idx] < num_steps]
+        if send_ids:
+            env2.send(acts[steps[send_ids], send_ids], send_ids)
+    assert np.all(steps == num_steps)
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="thread affinity is only supported on linux")
+def test_thread_affinity():
+    kwargs = dict(num=8, env_name="maze", rand_seed=3, num_threads=3)
+    env1 = ProcgenGym3Env(thread_affinity=[0], **kwargs)
+    env2 = ProcgenGym3Env(**kwargs)
+    assert env1.get_worker_cpus() == [0, 0, 0]
+    assert env2.get_worker_cpus() == [-1, -1, -1]
+
+    # games created on the stepping threads should behave the same as ones created on the calling thread
+    rng = np.random.RandomState(0)
+    for _ in range(50):
+        rew1, obs1, first1 = env1.observe()
+        rew2, obs2, first2 = env2.observe()
+        assert np.array_equal(rew1, rew2)
+        assert np.array_equal(obs1["rgb"], obs2["rgb"])
+        assert np.array_equal(first1, first2)
+        ac = rng.randint(low=0, high=env1.ac_space.eltype.n, size=(env1.num,), dtype=np.int32)
+        env1.act(ac)
+        env2.act(ac)
+
+
 @pytest.mark.parametrize("env_name", ENV_NAMES)
 @pytest.mark.parametrize("num_envs", [1, 2, 16])
 def test_multi_speed(env_name, num_envs, benchmark):
@@ -66,4 +259,285 @@ def test_multi_speed(env_name, num_envs, benchmark):
             env.observe()
             step_count += 1
 
-    benchmark(lambda: rollout(1000))
\ No newline at end of file
+    benchmark(lambda: rollout(1000))
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_native_renderer(env_name):
+    # the native renderer is not pixel identical to qt, but should be close
+    def collect_observations(renderer):
+        rng = np.random.RandomState(0)
+        env = ProcgenGym3Env(num=2, env_name=env_name, rand_seed=23, renderer=renderer)
+        _, obs, _ = env.observe()
+        obses = [obs["rgb"]]
+        for _ in range(32):
+            env.act(
+                rng.randint(
+                    low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+                )
+            )
+            _, obs, _ = env.observe()
+            obses.append(obs["rgb"])
+        return np.array(obses).astype(np.float32)
+
+    qt_obs = collect_observations("qt")
+    native_obs = collect_observations("native")
+    assert np.mean(np.abs(qt_obs - native_obs)) < 8
+    # fraction of pixels that are substantially different
+    assert np.mean(np.max(np.abs(qt_obs - native_obs), axis=-1) > 64) < 0.05
+
+
+def _collect_observations(env_name, num_steps=32, idle_prob=0.0, **kwargs):
+    rng = np.random.RandomState(0)
+    env = ProcgenGym3Env(num=2, env_name=env_name, rand_seed=23, **kwargs)
+    _, obs, _ = env.observe()
+    obses = [obs["rgb"]]
+    for _ in range(num_steps):
+        acts = rng.randint(
+            low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+        )
+        # action 4 does nothing, idling lets the camera come to rest
+        acts[rng.uniform(size=env.num) < idle_prob] = 4
+        env.act(acts)
+        _, obs, _ = env.observe()
+        obses.append(obs["rgb"])
+    return np.array(obses)
+
+
+@pytest.mark.parametrize("env_name", ENV_NAMES)
+def test_cache_scaled_assets(env_name):
+    # the cache is only used where it draws the same pixels as scaling the asset while drawing
+    cached_obs = _collect_observations(env_name)
+    uncached_obs = _collect_observations(env_name, cache_scaled_assets=False)
+    assert np.array_equal(cached_obs, uncached_obs)
+
+
+STATIC_LAYER_ENV_NAMES = ["caveflyer", "chaser", "heist", "jumper", "maze", "miner"]
+
+
+@pytest.mark.parametrize("env_name", STATIC_LAYER_ENV_NAMES)
+@pytest.mark.parametrize("renderer", ["qt", "native"])
+@pytest.mark.parametrize("center_agent", [False, True])
+def test_cache_static_layer(env_name, renderer, center_agent):
+    # the static layer is only repainted where cells change, and with center_agent the frame is a window of
+    # it that moves with the camera, either way it must draw the same pixels as a full frame
+    kwargs = dict(num_steps=512, idle_prob=0.8, center_agent=center_agent, renderer=renderer)
+    cached_obs = _collect_observations(env_name, **kwargs)
+    uncached_obs = _collect_observations(env_name, cache_static_layer=False, **kwargs)
+    assert np.array_equal(cached_obs, uncached_obs)
+
+
+def _collect_states(env_name, num_steps=256, **kwargs):
+    rng = np.random.RandomState(0)
+    env = ProcgenGym3Env(num=2, env_name=env_name, rand_seed=23, **kwargs)
+    states = [env.get_state()]
+    rews = []
+    for _ in range(num_steps):
+        env.act(
+            rng.randint(
+                low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32
+            )
+        )
+        rew, _, _ = env.observe()
+        rews.append(rew)
+        states.append(env.get_state())
+    return states, np.array(rews)
+
+
+@pytest.mark.parametrize("env_name", ["bigfish", "plunder", "starpilot"])
+def test_entity_grid(env_name):
+    # the grid only narrows down which entities are checked for collisions, so the games must step the same
+    grid_states, grid_rews = _collect_states(env_name, entity_grid_min_entities=0)
+    scan_states, scan_rews = _collect_states(env_name, entity_grid_min_entities=2 ** 30)
+    assert grid_states == scan_states
+    assert np.array_equal(grid_rews, scan_rews)
+
+
+@pytest.mark.parametrize("env_name", ["bigfish", "plunder", "starpilot"])
+def test_sweep_and_prune(env_name):
+    # force sweep and prune on for every entity count, and compare against scanning every entity
+    sweep_states, sweep_rews = _collect_states(env_name, entity_grid_min_entities=2 ** 30, sweep_min_entities=0)
+    scan_states, scan_rews = _collect_states(env_name, entity_grid_min_entities=2 ** 30, sweep_min_entities=2 ** 30)
+    assert sweep_states == scan_states
+    assert np.array_equal(sweep_rews, scan_rews)
+
+
+def _convert_bgr32_to_rgb888(env, simd_level, src):
+    h, w, _ = src.shape
+    dst = np.zeros((h, w, 3), dtype=np.uint8)
+    used = env.call_c_func(
+        "convert_bgr32_to_rgb888",
+        simd_level,
+        env._ffi.from_buffer("char[]", dst),
+        env._ffi.from_buffer("char[]", src),
+        w,
+        h,
+    )
+    return used, dst
+
+
+@pytest.mark.parametrize("simd_level", [1, 2, 3])
+def test_pixel_convert(simd_level):
+    # every kernel must match the scalar one exactly, including the tail handling for odd sizes
+    env = ProcgenGym3Env(num=1, env_name="coinrun")
+    rng = np.random.RandomState(0)
+    for w, h in [(1, 1), (3, 5), (17, 1), (64, 64), (127, 3), (512, 512)]:
+        src = rng.randint(0, 256, size=(h, w, 4), dtype=np.uint8)
+        _, expected = _convert_bgr32_to_rgb888(env, 0, src)
+        assert np.array_equal(expected, src[:, :, 2::-1])
+        _, actual = _convert_bgr32_to_rgb888(env, simd_level, src)
+        assert np.array_equal(expected, actual)
+
+
+@pytest.mark.parametrize("simd_level", [0, 1, 2, 3])
+def test_pixel_convert_speed(simd_level, benchmark):
+    env = ProcgenGym3Env(num=1, env_name="coinrun")
+    src = np.random.RandomState(0).randint(0, 256, size=(512, 512, 4), dtype=np.uint8)
+    used, _ = _convert_bgr32_to_rgb888(env, simd_level, src)
+    if used != simd_level:
+        pytest.skip(f"simd level {simd_level} not supported on this cpu")
+    benchmark(lambda: _convert_bgr32_to_rgb888(env, simd_level, src))
+
+
+@pytest.mark.parametrize("max_pool_frames", [False, True])
+def test_action_repeat(max_pool_frames):
+    # repeating inside the environment should match stepping the same action several times
+    repeat = 3
+    kwargs = dict(num=1, env_name="starpilot", rand_seed=23)
+    env1 = ProcgenGym3Env(action_repeat=repeat, max_pool_frames=max_pool_frames, **kwargs)
+    env2 = ProcgenGym3Env(**kwargs)
+    rng = np.random.RandomState(0)
+
+    for _ in range(200):
+        ac = rng.randint(low=0, high=env1.ac_space.eltype.n, size=(env1.num,), dtype=np.int32)
+        env1.act(ac)
+        rew1, obs1, first1 = env1.observe()
+
+        rew2 = np.zeros(env2.num, dtype=np.float32)
+        frames = []
+        for _ in range(repeat):
+            env2.act(ac)
+            rew, obs2, first2 = env2.observe()
+            rew2 += rew
+            frames.append(obs2["rgb"])
+            if first2[0]:
+                break
+
+        expected = frames[-1]
+        if max_pool_frames and not first2[0]:
+            expected = np.maximum(frames[-2], frames[-1])
+
+        assert np.array_equal(first1, first2)
+        assert np.allclose(rew1, rew2)
+        assert np.array_equal(obs1["rgb"], expected)
+
+
+def test_frame_stack():
+    # stacked observations should match stacking the frames of an unstacked environment
+    n = 4
+    kwargs = dict(num=2, env_name="coinrun", rand_seed=5)
+    env1 = ProcgenGym3Env(frame_stack=n, **kwargs)
+    env2 = ProcgenGym3Env(**kwargs)
+    rng = np.random.RandomState(0)
+
+    def update(stack, obs, first):
+        for i in range(env2.num):
+            if first[i]:
+                stack[i] = 0
+            stack[i] = np.roll(stack[i], -1, axis=0)
+            stack[i, -1] = obs["rgb"][i]
+
+    stack = np.zeros((env2.num, n, 64, 64, 3), dtype=np.uint8)
+    _, obs2, first2 = env2.observe()
+    update(stack, obs2, first2)
+
+    for step in range(500):
+        _, obs1, first1 = env1.observe()
+        assert obs1["rgb"].shape == (env1.num, n, 64, 64, 3)
+        assert np.array_equal(first1, first2)
+        assert np.array_equal(obs1["rgb"], stack)
+
+        if step == 250:
+            # the stack is part of the state, so restoring it should give the same observation
+            states = env1.callmethod("get_state")
+            env1.callmethod("set_state", states)
+            _, obs1, _ = env1.observe()
+            assert np.array_equal(obs1["rgb"], stack)
+
+        ac = rng.randint(low=0, high=env1.ac_space.eltype.n, size=(env1.num,), dtype=np.int32)
+        env1.act(ac)
+        env2.act(ac)
+        _, obs2, first2 = env2.observe()
+        update(stack, obs2, first2)
+
+
+def test_frame_stack_state_format():
+    # without a frame stack, states keep the original format, version 0 at the start
+    kwargs = dict(num=2, env_name="coinrun", rand_seed=5)
+    env1 = ProcgenGym3Env(**kwargs)
+    states = env1.callmethod("get_state")
+    assert all(np.frombuffer(state[:4], dtype=np.int32)[0] == 0 for state in states)
+
+    # such a state can be loaded into an environment with a stack, which then only has the newest frame
+    env2 = ProcgenGym3Env(frame_stack=4, **kwargs)
+    env2.callmethod("set_state", states)
+    _, obs1, _ = env1.observe()
+    _, obs2, _ = env2.observe()
+    assert not obs2["rgb"][:, :-1].any()
+    assert np.array_equal(obs2["rgb"][:, -1], obs1["rgb"])
+
+
+def test_render_env_ids():
+    # only the selected environments should produce human frames, and only on every k-th step
+    kwargs = dict(num=3, env_name="maze", rand_seed=9, render_mode="rgb_array")
+    env1 = ProcgenGym3Env(**kwargs)
+    env2 = ProcgenGym3Env(render_env_ids=[1], render_interval=2, **kwargs)
+    rng = np.random.RandomState(0)
+
+    last_frame = None
+    for step in range(20):
+        frames1 = [info["rgb"] for info in env1.get_info()]
+        frames2 = [info["rgb"] for info in env2.get_info()]
+        assert not frames2[0].any() and not frames2[2].any()
+        if step % 2 == 0:
+            last_frame = frames1[1]
+        assert np.array_equal(frames2[1], last_frame)
+
+        ac = rng.randint(low=0, high=env1.ac_space.eltype.n, size=(env1.num,), dtype=np.int32)
+        env1.act(ac)
+        env2.act(ac)
+
+
+def test_obs_spaces():
+    # the reduced observations should be derived from the same frame as the rgb observation
+    env = ProcgenGym3Env(num=2, env_name="bigfish", obs_spaces=("gray", "rgb_32", "rgb"))
+    assert env.ob_space["gray"].shape == (64, 64)
+    assert env.ob_space["rgb_32"].shape == (32, 32, 3)
+    rng = np.random.RandomState(0)
+
+    for _ in range(100):
+        _, obs, _ = env.observe()
+        rgb = obs["rgb"].astype(np.int32)
+        gray = (77 * rgb[..., 0] + 150 * rgb[..., 1] + 29 * rgb[..., 2] + 128) >> 8
+        assert np.array_equal(obs["gray"], gray)
+        box = rgb[:, 0::2, 0::2] + rgb[:, 0::2, 1::2] + rgb[:, 1::2, 0::2] + rgb[:, 1::2, 1::2]
+        assert np.array_equal(obs["rgb_32"], (box + 2) >> 2)
+
+        ac = rng.randint(low=0, high=env.ac_space.eltype.n, size=(env.num,), dtype=np.int32)
+        env.act(ac)
+
+    env = ProcgenGym3Env(num=2, env_name="bigfish", obs_spaces=("gray",))
+    assert list(env.ob_space.keys()) == ["gray"]
+
+    env = ProcgenGym3Env(num=2, env_name="bigfish", obs_spaces="gray")
+    assert list(env.ob_space.keys()) == ["gray"]
+
+    with pytest.raises(TypeError):
+        ProcgenGym3Env(num=2, env_name="bigfish", obs_spaces=(1,))
+
+    # without an rgb observation, images come from the human render or are rejected with a clear error
+    env = ProcgenEnv(num_envs=2, env_name="bigfish", obs_spaces=("gray",))
+    with pytest.raises(Exception, match="obs_spaces"):
+        env.get_images()
+    env = ProcgenEnv(num_envs=2, env_name="bigfish", obs_spaces=("gray",), render_mode="rgb_array")
+    assert env.get_images().shape == (2, 512, 512, 3)
+    assert env.render(mode="rgb_array").shape == (512, 512, 3)
@@ -19,6 +19,24 @@ const int USE_ASSET_THRESHOLD = 100;
 const int MAX_ASSETS = USE_ASSET_THRESHOLD;
 const int MAX_IMAGE_THEMES = 10;
 
+// the scaled asset cache is cleared when it grows past this many entries
+const size_t MAX_SCALED_ASSETS = 1024;
+
+// rects within this many pixels of the pixel grid count as being on it, this only absorbs float rounding
+const float PIXEL_ALIGN_EPS = 1e-4f;
+
+// past this many changed cells in one frame, the static layer is repainted entirely
+const size_t MAX_STATIC_LAYER_DIRTY_CELLS = 256;
+
+// static layers larger than this in either dimension are not used
+const int MAX_STATIC_LAYER_DIM = 4096;
+
+// with center_agent, the layer extends this many views past the visible cells on each side
+const float STATIC_LAYER_MARGIN_VIEWS = 0.5f;
+
+// with center_agent, the camera phase must have stayed the same for this many frames before the layer is repainted
+const int STATIC_LAYER_STABLE_FRAMES = 2;
+
 BasicAbstractGame::BasicAbstractGame(std::string name)
     : Game(name) {
     char_dim = 5;
@@ -49,6 +67,11 @@ BasicAbstractGame::~BasicAbstractGame() {
     if (main_bg_images_ptr != nullptr && use_procgen_background) {
         delete main_bg_images_ptr;
     }
+
+    // the entities have to go before the pool their memory came from, the games' own references to them are
+    // already gone since members of the derived classes are destroyed first
+    entities.clear();
+    agent.reset();
 }
 
 void BasicAbstractGame::game_init() {
@@ -67,6 +90,8 @@ void BasicAbstractGame::game_init() {
 
     basic_assets.clear();
     basic_reflections.clear();
+    scaled_assets.clear();
+    static_layer_valid = false;
     asset_aspect_ratios.clear();
     asset_num_themes.clear();
 
@@ -125,7 +150,10 @@ void BasicAbstractGame::initialize_asset_if_necessary(int img_idx) {
 void BasicAbstractGame::fill_elem(int x, int y, int dx, int dy, char elem) {
     for (int j = 0; j < dx; j++) {
         for (int k = 0; k < dy; k++) {
-            grid.set(x + j, y + k, elem);
+            if (grid.get(x + j, y + k) != elem) {
+                grid.set(x + j, y + k, elem);
+                mark_cell_dirty(grid.to_index(x + j, y + k));
+            }
         }
     }
 }
@@ -142,7 +170,8 @@ float BasicAbstractGame::get_distance(const std::shared_ptr<Entity> &p0, const s
     return sqrt(dx * dx + dy * dy);
 }
 
-void BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent) {
+// returns true if handle_grid_collision was called
+bool BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent) {
     float ax = ent->x;
     float ay = ent->y;
     float arx = ent->rx;
@@ -153,15 +182,20 @@ void BasicAbstractGame::check_grid_collisions(const std::shared_ptr<Entity> &ent
     int min_y = int(ay - (ary + POS_EPS));
     int max_y = int(ay + (ary + POS_EPS));
 
+    bool handled = false;
+
     for (int x = min_x; x <= max_x; x++) {
         for (int y = min_y; y <= max_y; y++) {
             int grid_type = get_obj_from_floats(x, y);
 
             if (grid_type != SPACE) {
                 handle_grid_collision(ent, grid_type, x, y);
+                handled = true;
             }
         }
     }
+
+    return handled;
 }
 
 int BasicAbstractGame::get_obj_from_floats(float i, float j) {
@@ -215,17 +249,23 @@ std::vector<int> BasicAbstractGame::get_cells_with_type(int type) {
 }
 
 void BasicAbstractGame::set_obj(int idx, int elem) {
-    grid.set_index(idx, elem);
+    if (grid.get_index(idx) != elem) {
+        grid.set_index(idx, elem);
+        mark_cell_dirty(idx);
+    }
 }
 
 void BasicAbstractGame::set_obj(int x, int y, int elem) {
-    grid.set(x, y, elem);
+    if (grid.get(x, y) != elem) {
+        grid.set(x, y, elem);
+        mark_cell_dirty(grid.to_index(x, y));
+    }
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::spawn_child(const std::shared_ptr<Entity> &src, int type, float obj_r, bool match_vel) {
     float vx = match_vel ? src->vx : 0;
     float vy = match_vel ? src->vy : 0;
-    auto child = std::make_shared<Entity>(src->x, src->y, vx, vy, obj_r, type);
+    auto child = make_entity(src->x, src->y, vx, vy, obj_r, type);
     entities.push_back(child);
     return child;
 }
@@ -334,13 +374,7 @@ bool BasicAbstractGame::sub_step(const std::shared_ptr<Entity> &obj, float _vx,
 
     bool block2 = false;
 
-    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto m = entities[i];
-
-        if (m == obj || m->will_erase) {
-            continue;
-        }
-
+    auto collide_with = [&](const std::shared_ptr<Entity> &m) {
         bool curr_block = false;
 
         if (has_collision(obj, m, POS_EPS)) {
@@ -365,7 +399,60 @@ bool BasicAbstractGame::sub_step(const std::shared_ptr<Entity> &obj, float _vx,
             }
         }
 
-        block2 = block2 || curr_block;
+        return curr_block;
+    };
+
+    bool use_sweep = !entity_grid_active && sweep_idx >= 0 && entities[sweep_idx] == obj;
+
+    if (entity_grid_active || use_sweep) {
+        // only obj moves until this returns, so the candidates stay valid for every other entity
+        auto &candidates = sub_step_candidates[depth];
+        auto find_candidates = [&](int limit) {
+            if (entity_grid_active) {
+                entity_grid.query(obj->x, obj->y, obj->rx + POS_EPS, obj->ry + POS_EPS, limit, &candidates);
+            } else if (sweep.contains(sweep_idx, *obj)) {
+                sweep.candidates(sweep_idx, limit, &candidates);
+            } else {
+                // obj left the box its candidates were found for
+                candidates.clear();
+                for (int i = limit - 1; i >= 0; i--) {
+                    candidates.push_back(i);
+                }
+            }
+        };
+        find_candidates((int)(entities.size()));
+
+        size_t k = 0;
+        while (k < candidates.size()) {
+            int i = candidates[k++];
+            const auto &m = entities[i];
+
+            if (m == obj || m->will_erase) {
+                continue;
+            }
+
+            float prev_x = obj->x;
+            float prev_y = obj->y;
+            bool curr_block = collide_with(m);
+            block2 = block2 || curr_block;
+
+            // obj was reflected or pushed, look for the entities below i that are near its new position
+            if (obj->x != prev_x || obj->y != prev_y) {
+                find_candidates(i);
+                k = 0;
+            }
+        }
+    } else {
+        for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
+            const auto &m = entities[i];
+
+            if (m == obj || m->will_erase) {
+                continue;
+            }
+
+            bool curr_block = collide_with(m);
+            block2 = block2 || curr_block;
+        }
     }
 
     return block || block2;
@@ -509,7 +596,7 @@ float BasicAbstractGame::get_agent_acceleration_scale() {
 */
 
 std::shared_ptr<Entity> BasicAbstractGame::spawn_entity_rxy(float rx, float ry, int type, float x, float y, float w, float h, bool check_collisions) {
-    std::shared_ptr<Entity> ent(new Entity(0, 0, 0, 0, rx, ry, type));
+    auto ent = make_entity(0, 0, 0, 0, rx, ry, type);
 
     reposition(ent, x, y, w, h, check_collisions);
 
@@ -519,7 +606,20 @@ std::shared_ptr<Entity> BasicAbstractGame::spawn_entity_rxy(float rx, float ry,
 }
 
 bool BasicAbstractGame::agent_has_collision() {
-    for (auto ent : entities) {
+    if (entity_grid_active) {
+        float margin = entity_grid.max_collision_margin;
+        entity_grid.query(agent->x, agent->y, agent->rx + margin, agent->ry + margin, (int)(entities.size()), &nearby_candidates);
+
+        for (int i : nearby_candidates) {
+            if (has_agent_collision(entities[i])) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    for (const auto &ent : entities) {
         if (has_agent_collision(ent)) {
             return true;
         }
@@ -530,12 +630,21 @@ bool BasicAbstractGame::agent_has_collision() {
 
 void BasicAbstractGame::reposition_agent() {
     int count = 0;
+    bool was_grid_active = entity_grid_active;
 
     do {
+        // the first position collided, the agent never collides with itself so it can be left in the grid
+        if (count == 1 && agent->type == PLAYER && should_use_entity_grid()) {
+            build_entity_grid();
+            entity_grid_active = true;
+        }
+
         agent->x = rand_gen.rand01() * (main_width - 2 * agent->rx) + agent->rx;
         agent->y = rand_gen.rand01() * (main_height - 2 * agent->ry) + agent->ry;
         count++;
     } while (agent_has_collision() && (count < 100));
+
+    entity_grid_active = was_grid_active;
 }
 
 void BasicAbstractGame::reposition(const std::shared_ptr<Entity> &ent, float x, float y, float w, float h, bool check_collisions) {
@@ -546,13 +655,22 @@ void BasicAbstractGame::reposition(const std::shared_ptr<Entity> &ent, float x,
     ent->y = rand_pos(ry, y, y + h);
 
     int count = 0;
+    bool was_grid_active = entity_grid_active;
 
     while ((has_agent_collision(ent) || (check_collisions && has_any_collision(ent))) && (count < 100)) {
+        // only ent moves between the attempts, which is fine as long as it isn't one of the entities
+        if (count == 0 && check_collisions && should_use_entity_grid() && std::find(entities.begin(), entities.end(), ent) == entities.end()) {
+            build_entity_grid();
+            entity_grid_active = true;
+        }
+
         ent->x = rand_pos(rx, x, x + w);
         ent->y = rand_pos(ry, y, y + h);
         count++;
     }
 
+    entity_grid_active = was_grid_active;
+
     if (count == 100) {
         printf("WARNING: excessive randomization attempts. Game num, type, rx, ry, w, h: %d %d %f_%f %d %d \n", game_n, ent->type, rx, ry, main_width, main_height);
         printf("Agent: %f %f\n", agent->x, agent->y);
@@ -564,13 +682,13 @@ std::shared_ptr<Entity> BasicAbstractGame::spawn_entity(float r, int type, float
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::add_entity(float x, float y, float vx, float vy, float r, int type) {
-    std::shared_ptr<Entity> ent(new Entity(x, y, vx, vy, r, r, type));
+    auto ent = make_entity(x, y, vx, vy, r, r, type);
     entities.push_back(ent);
     return ent;
 }
 
 std::shared_ptr<Entity> BasicAbstractGame::add_entity_rxy(float x, float y, float vx, float vy, float rx, float ry, int type) {
-    std::shared_ptr<Entity> ent(new Entity(x, y, vx, vy, rx, ry, type));
+    auto ent = make_entity(x, y, vx, vy, rx, ry, type);
     entities.push_back(ent);
     return ent;
 }
@@ -716,27 +834,65 @@ void BasicAbstractGame::game_step() {
 
     step_entities(entities);
 
+    // the handlers can move, resize or add any entity, so the grid is rebuilt after one is called
+    bool use_grid = should_use_entity_grid();
+    bool grid_dirty = true;
+
+    // the handlers can add entities, which may move the shared_ptrs around in the vector, but not the entities
+    // themselves, so the loop holds on to entities by raw pointer and only copies a shared_ptr for the rare
+    // handler call
     for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto ent = entities[i];
+        Entity *ent = entities[i].get();
 
-        if (has_agent_collision(ent)) {
-            handle_agent_collision(ent);
+        if (has_agent_collision(entities[i])) {
+            std::shared_ptr<Entity> obj = entities[i];
+            handle_agent_collision(obj);
+            grid_dirty = true;
         }
 
-        if (ent->collides_with_entities) {
+        if (ent->collides_with_entities && use_grid) {
+            if (grid_dirty) {
+                build_entity_grid();
+                grid_dirty = false;
+            }
+
+            entity_grid.query(ent->x, ent->y, ent->rx + ent->collision_margin, ent->ry + ent->collision_margin, (int)(entities.size()), &collision_candidates);
+
+            size_t k = 0;
+            while (k < collision_candidates.size()) {
+                int j = collision_candidates[k++];
+                if (i == j)
+                    continue;
+
+                if (has_collision(entities[i], entities[j], ent->collision_margin) && !ent->will_erase && !entities[j]->will_erase) {
+                    std::shared_ptr<Entity> src = entities[i];
+                    std::shared_ptr<Entity> target = entities[j];
+                    handle_collision(src, target);
+
+                    // look again for the entities below j
+                    build_entity_grid();
+                    entity_grid.query(ent->x, ent->y, ent->rx + ent->collision_margin, ent->ry + ent->collision_margin, j, &collision_candidates);
+                    k = 0;
+                }
+            }
+        } else if (ent->collides_with_entities) {
             for (int j = (int)(entities.size()) - 1; j >= 0; j--) {
                 if (i == j)
                     continue;
-                auto ent2 = entities[j];
 
-                if (has_collision(ent, ent2, ent->collision_margin) && !ent->will_erase && !ent2->will_erase) {
-                    handle_collision(ent, ent2);
+                if (has_collision(entities[i], entities[j], ent->collision_margin) && !ent->will_erase && !entities[j]->will_erase) {
+                    std::shared_ptr<Entity> src = entities[i];
+                    std::shared_ptr<Entity> target = entities[j];
+                    handle_collision(src, target);
                 }
             }
         }
 
         if (ent->smart_step) {
-            check_grid_collisions(ent);
+            std::shared_ptr<Entity> obj = entities[i];
+            if (check_grid_collisions(obj)) {
+                grid_dirty = true;
+            }
         }
     }
 
@@ -746,13 +902,24 @@ void BasicAbstractGame::game_step() {
 }
 
 void BasicAbstractGame::erase_if_needed() {
-    for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto e = entities[i];
+    // compact in a single pass so that erasing many entities at once stays linear, the remaining
+    // entities keep their order
+    size_t num_kept = 0;
+
+    for (size_t i = 0; i < entities.size(); i++) {
+        const auto &e = entities[i];
 
         if (e->will_erase || (e->auto_erase && is_out_of_bounds(e))) {
-            entities.erase(entities.begin() + i);
+            continue;
+        }
+
+        if (num_kept != i) {
+            entities[num_kept] = std::move(entities[i]);
         }
+        num_kept++;
     }
+
+    entities.resize(num_kept);
 }
 
 void BasicAbstractGame::game_reset() {
@@ -763,6 +930,7 @@ void BasicAbstractGame::game_reset() {
 
     grid_size = main_width * main_height;
     grid.resize(main_width, main_height);
+    static_layer_valid = false;
 
     background_index = rand_gen.randn((int)(main_bg_images_ptr->size()));
 
@@ -785,7 +953,7 @@ void BasicAbstractGame::game_reset() {
         ay = a_r;
     }
 
-    auto _agent = std::make_shared<Entity>(ax, ay, 0, 0, a_r, PLAYER);
+    auto _agent = make_entity(ax, ay, 0, 0, a_r, PLAYER);
     agent = _agent;
     agent->smart_step = true;
     agent->render_z = 1;
@@ -837,7 +1005,7 @@ void BasicAbstractGame::prepare_for_drawing(float rect_height) {
     y_off = unit * (center_y - view_dim / 2);
 }
 
-void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio) {
+void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio, int img_idx, bool is_reflected) {
     if (tile_ratio != 0) {
         if (tile_ratio < 0) {
             tile_ratio = -1 * tile_ratio;
@@ -849,7 +1017,7 @@ void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rec
 
             for (int i = 0; i < num_tiles; i++) {
                 QRectF tile_rect = QRectF(rect.x(), rect.y() + tile_height * i, tile_width, tile_height);
-                p.drawImage(tile_rect, *image);
+                draw_scaled_image(p, tile_rect, *image, img_idx, is_reflected);
             }
         } else {
             int num_tiles = int(rect.width() / (rect.height() * tile_ratio));
@@ -860,11 +1028,56 @@ void BasicAbstractGame::tile_image(QPainter &p, QImage *image, const QRectF &rec
 
             for (int i = 0; i < num_tiles; i++) {
                 QRectF tile_rect = QRectF(rect.x() + tile_width * i, rect.y(), tile_width, tile_height);
-                p.drawImage(tile_rect, *image);
+                draw_scaled_image(p, tile_rect, *image, img_idx, is_reflected);
             }
         }
     } else {
-        p.drawImage(rect, *image);
+        draw_scaled_image(p, rect, *image, img_idx, is_reflected);
+    }
+}
+
+static bool align_to_pixels(const QRectF &rect, QRect *aligned) {
+    int x0 = (int)floor(rect.x() + 0.5f);
+    int y0 = (int)floor(rect.y() + 0.5f);
+    int x1 = (int)floor(rect.x() + rect.width() + 0.5f);
+    int y1 = (int)floor(rect.y() + rect.height() + 0.5f);
+
+    // a rect off the pixel grid samples the asset at a different phase than a prescaled copy would, so
+    // only rects already on the grid can be blitted without changing what gets drawn
+    if (fabs(rect.x() - x0) > PIXEL_ALIGN_EPS || fabs(rect.y() - y0) > PIXEL_ALIGN_EPS || fabs(rect.x() + rect.width() - x1) > PIXEL_ALIGN_EPS || fabs(rect.y() + rect.height() - y1) > PIXEL_ALIGN_EPS) {
+        return false;
+    }
+
+    *aligned = QRect(x0, y0, x1 - x0, y1 - y0);
+    return true;
+}
+
+/*
+  img_idx (if not -1) identifies the asset being drawn, this allows using a copy of the asset
+  that has already been resampled to the size of the rect
+*/
+void BasicAbstractGame::draw_scaled_image(QPainter &p, const QRectF &rect, const QImage &image, int img_idx, bool is_reflected) {
+    QRect aligned;
+
+    if (img_idx >= 0 && options.cache_scaled_assets && align_to_pixels(rect, &aligned)) {
+        if (aligned.width() <= 0 || aligned.height() <= 0) {
+            return;
+        }
+
+        QImage *scaled = lookup_scaled_asset(img_idx, is_reflected, aligned.width(), aligned.height());
+
+        if (options.renderer == NativeRenderer) {
+            rasterizer.draw_image(QRectF(aligned), *scaled);
+        } else {
+            p.drawImage(QPoint(aligned.x(), aligned.y()), *scaled);
+        }
+        return;
+    }
+
+    if (options.renderer == NativeRenderer) {
+        rasterizer.draw_image(rect, image);
+    } else {
+        p.drawImage(rect, image);
     }
 }
 
@@ -874,6 +1087,30 @@ QImage *BasicAbstractGame::lookup_asset(int img_idx, bool is_reflected) {
     return assets->at(img_idx).get();
 }
 
+static uint64_t scaled_asset_key(int img_idx, bool is_reflected, bool antialiased, int w, int h) {
+    return ((uint64_t)img_idx << 34) | ((uint64_t)is_reflected << 33) | ((uint64_t)antialiased << 32) | ((uint64_t)(w & 0xffff) << 16) | (uint64_t)(h & 0xffff);
+}
+
+QImage *BasicAbstractGame::lookup_scaled_asset(int img_idx, bool is_reflected, int w, int h) {
+    uint64_t key = scaled_asset_key(img_idx, is_reflected, render_antialiased, w, h);
+    auto it = scaled_assets.find(key);
+
+    if (it != scaled_assets.end()) {
+        return it->second.get();
+    }
+
+    if (scaled_assets.size() >= MAX_SCALED_ASSETS) {
+        scaled_assets.clear();
+    }
+
+    QImage *asset = lookup_asset(img_idx, is_reflected);
+    auto mode = render_antialiased ? Qt::SmoothTransformation : Qt::FastTransformation;
+    auto scaled = std::make_shared<QImage>(asset->scaled(w, h, Qt::IgnoreAspectRatio, mode));
+    scaled_assets[key] = scaled;
+
+    return scaled.get();
+}
+
 void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotation, bool is_reflected, int base_type, int theme, float alpha, float tile_ratio) {
     int img_type = image_for_type(base_type);
 
@@ -891,13 +1128,24 @@ void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotatio
 
         auto asset_ptr = lookup_asset(img_idx, is_reflected);
 
+        if (options.renderer == NativeRenderer) {
+            rasterizer.set_opacity(alpha);
+            if (rotation == 0) {
+                tile_image(p, asset_ptr, adjusted_rect, tile_ratio, img_idx, is_reflected);
+            } else {
+                rasterizer.draw_image(adjusted_rect, *asset_ptr, rotation);
+            }
+            rasterizer.set_opacity(1);
+            return;
+        }
+
         if (alpha != 1) {
             p.save();
             p.setOpacity(alpha);
         }
 
         if (rotation == 0) {
-            tile_image(p, asset_ptr, adjusted_rect, tile_ratio);
+            tile_image(p, asset_ptr, adjusted_rect, tile_ratio, img_idx, is_reflected);
         } else {
             p.save();
             p.translate(adjusted_rect.x() + adjusted_rect.width() / 2, adjusted_rect.y() + adjusted_rect.height() / 2);
@@ -915,16 +1163,10 @@ void BasicAbstractGame::draw_image(QPainter &p, QRectF &base_rect, float rotatio
 void BasicAbstractGame::draw_grid_obj(QPainter &p, const QRectF &rect, int type, int theme) {
     if (type == SPACE)
         return;
-    p.fillRect(rect, color_for_type(type, theme));
+    fill_rect(p, rect, color_for_type(type, theme));
 }
 
-void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
-    prepare_for_drawing(rect.height());
-
-    draw_entities(p, entities, -1);
-
-    int low_x, high_x, low_y, high_y;
-
+void BasicAbstractGame::get_visible_cells(int &low_x, int &high_x, int &low_y, int &high_y) {
     if (options.center_agent) {
         float margin = (visibility / 2.0 + 1);
         low_x = center_x - margin;
@@ -937,7 +1179,9 @@ void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
         low_y = 0;
         high_y = main_height - 1;
     }
+}
 
+void BasicAbstractGame::draw_grid(QPainter &p, int low_x, int high_x, int low_y, int high_y) {
     for (int x = low_x; x <= high_x; x++) {
         for (int y = low_y; y <= high_y; y++) {
             int type = get_obj(x, y);
@@ -953,7 +1197,21 @@ void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
             draw_image(p, r2, 0, false, type, theme, 1.0, 0.0);
         }
     }
+}
 
+void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
+    prepare_for_drawing(rect.height());
+
+    draw_entities(p, entities, -1);
+
+    int low_x, high_x, low_y, high_y;
+    get_visible_cells(low_x, high_x, low_y, high_y);
+    draw_grid(p, low_x, high_x, low_y, high_y);
+
+    draw_dynamic_layers(p, rect);
+}
+
+void BasicAbstractGame::draw_dynamic_layers(QPainter &p, const QRect &rect) {
     draw_entities(p, entities, 0);
     draw_entities(p, entities, 1);
 
@@ -962,25 +1220,318 @@ void BasicAbstractGame::draw_foreground(QPainter &p, const QRect &rect) {
         QRectF dst2 = QRectF(0, 0, infodim, infodim);
         int s1 = to_shade(.5 * agent->vx / maxspeed + .5);
         int s2 = to_shade(.5 * agent->vy / max_jump + .5);
-        p.fillRect(dst2, QColor(s1, s1, s1));
+        fill_rect(p, dst2, QColor(s1, s1, s1));
 
         QRectF dst3 = QRectF(infodim, 0, infodim, infodim);
-        p.fillRect(dst3, QColor(s2, s2, s2));
+        fill_rect(p, dst3, QColor(s2, s2, s2));
+    }
+}
+
+bool BasicAbstractGame::should_use_static_layer(const QRect &rect) {
+    // only observations are cached, other resolutions would force a full repaint every frame
+    return use_static_layer && options.cache_static_layer && !render_antialiased && rect.width() == RES_W && rect.height() == RES_H;
+}
+
+void BasicAbstractGame::mark_cell_dirty(int idx) {
+    if (!static_layer_valid) {
+        return;
+    }
+
+    if (static_layer_dirty.size() >= MAX_STATIC_LAYER_DIRTY_CELLS) {
+        static_layer_valid = false;
+        static_layer_dirty.clear();
+        return;
+    }
+
+    static_layer_dirty.push_back(idx);
+}
+
+/*
+  Choose the transform, size and cells of a new static layer for the current frame.
+
+  Without center_agent the layer is exactly the screen. With center_agent the layer covers the visible cells
+  plus a margin around them, so that it can be reused while the camera moves within the margin, and its offsets
+  differ from the frame's offsets by a whole number of pixels so that the frame is a window of the layer.
+*/
+void BasicAbstractGame::layout_static_layer(const QRect &rect) {
+    static_layer_renderer = options.renderer;
+    static_layer_unit = unit;
+
+    if (!options.center_agent) {
+        static_layer_x_off = x_off;
+        static_layer_y_off = y_off;
+        static_layer_size = rect.size();
+        get_visible_cells(static_layer_low_x, static_layer_high_x, static_layer_low_y, static_layer_high_y);
+        return;
+    }
+
+    int low_x, high_x, low_y, high_y;
+    get_visible_cells(low_x, high_x, low_y, high_y);
+    int margin = (int)ceil(view_dim * STATIC_LAYER_MARGIN_VIEWS);
+    static_layer_low_x = low_x - margin;
+    static_layer_high_x = high_x + margin;
+    static_layer_low_y = low_y - margin;
+    static_layer_high_y = high_y + margin;
+
+    // place the left column and top row of cells at the layer's origin, keeping the frame's sub-pixel phase
+    float left_x_off = static_layer_low_x * unit;
+    float top_y_off = (static_layer_high_y + 1 - view_dim) * unit;
+    static_layer_x_off = x_off - floor(x_off - left_x_off);
+    static_layer_y_off = y_off - floor(y_off - top_y_off);
+
+    int w = (int)ceil((static_layer_high_x + 1 - static_layer_low_x) * unit) + 2;
+    int h = (int)ceil((static_layer_high_y + 1 - static_layer_low_y) * unit) + 2;
+    static_layer_size = QSize(w, h);
+}
+
+/*
+  Find where the frame lies within the current static layer, fails if the frame's transform doesn't match
+  the layer up to a whole pixel offset or the frame shows cells the layer doesn't have.
+*/
+bool BasicAbstractGame::locate_in_static_layer(const QRect &rect, QPoint *origin) {
+    if (static_layer_renderer != options.renderer || static_layer_unit != unit) {
+        return false;
+    }
+
+    // screen x decreases as x_off grows while screen y increases with y_off
+    float dx = x_off - static_layer_x_off;
+    float dy = static_layer_y_off - y_off;
+    int ox = (int)floor(dx + 0.5f);
+    int oy = (int)floor(dy + 0.5f);
+
+    // even a tiny difference in sub-pixel position can move an aliased edge by a pixel
+    if (dx != ox || dy != oy) {
+        return false;
+    }
+
+    if (ox < 0 || oy < 0 || ox + rect.width() > static_layer_size.width() || oy + rect.height() > static_layer_size.height()) {
+        return false;
+    }
+
+    int low_x, high_x, low_y, high_y;
+    get_visible_cells(low_x, high_x, low_y, high_y);
+
+    if (low_x < static_layer_low_x || high_x > static_layer_high_x || low_y < static_layer_low_y || high_y > static_layer_high_y) {
+        return false;
+    }
+
+    *origin = QPoint(ox, oy);
+    return true;
+}
+
+/*
+  Bring the static layer up to date with the grid, either by repainting it entirely or by
+  repainting only the pixels around cells that have changed since the last frame.
+
+  Returns false if the frame should be drawn directly instead, origin is set to the position
+  of the frame within the layer.
+*/
+bool BasicAbstractGame::update_static_layer(const QRect &rect, QPoint *origin) {
+    // entities drawn below the grid are part of the layer, so any change to them requires a full repaint
+    static_layer_ents_next.clear();
+    for (const auto &ent : entities) {
+        if (ent->render_z == -1 && should_draw_entity(ent)) {
+            if (ent->use_abs_coords && options.center_agent) {
+                return false;
+            }
+            static_layer_ents_next.insert(static_layer_ents_next.end(), {ent->x, ent->y, ent->rx, ent->ry, ent->rotation, ent->alpha, (float)ent->image_type, (float)ent->image_theme, (float)ent->is_reflected, (float)ent->use_abs_coords, get_tile_aspect_ratio(ent)});
+        }
+    }
+
+    if (static_layer_ents_next != static_layer_ents) {
+        static_layer_valid = false;
+        static_layer_dirty.clear();
+    }
+
+    // aliased drawing depends on the sub-pixel position of the camera, so a layer can only be reused once the
+    // camera stops moving by fractions of a pixel, until it has settled for a few frames draw the frame directly
+    float phase_x = x_off - floor(x_off);
+    float phase_y = y_off - floor(y_off);
+    bool phase_changed = phase_x != static_layer_last_phase_x || phase_y != static_layer_last_phase_y;
+    static_layer_last_phase_x = phase_x;
+    static_layer_last_phase_y = phase_y;
+    static_layer_stable_frames = phase_changed ? 0 : static_layer_stable_frames + 1;
+
+    bool full_repaint = !static_layer_valid || !locate_in_static_layer(rect, origin);
+
+    if (full_repaint) {
+        if (options.center_agent && static_layer_stable_frames < STATIC_LAYER_STABLE_FRAMES) {
+            return false;
+        }
+
+        layout_static_layer(rect);
+
+        int max_dim = std::max(static_layer_size.width(), static_layer_size.height());
+        if (max_dim > MAX_STATIC_LAYER_DIM || !locate_in_static_layer(rect, origin)) {
+            static_layer_valid = false;
+            static_layer_dirty.clear();
+            return false;
+        }
+    }
+
+    std::swap(static_layer_ents, static_layer_ents_next);
+
+    if (!full_repaint && static_layer_dirty.empty()) {
+        return true;
+    }
+
+    if (static_layer.size() != static_layer_size) {
+        static_layer = QImage(static_layer_size.width(), static_layer_size.height(), QImage::Format_RGB32);
+    }
+
+    QRect layer_rect = QRect(0, 0, static_layer_size.width(), static_layer_size.height());
+
+    // the drawing helpers use the game's rasterizer and offsets, so point them at the layer for now
+    float frame_x_off = x_off;
+    float frame_y_off = y_off;
+    x_off = static_layer_x_off;
+    y_off = static_layer_y_off;
+
+    QPainter lp;
+    std::swap(rasterizer, static_layer_rasterizer);
+    pen_brush_painter = nullptr;
+
+    if (options.renderer == NativeRenderer) {
+        rasterizer.begin((uint32_t *)static_layer.bits(), layer_rect.width(), layer_rect.height(), false);
+    } else {
+        lp.begin(&static_layer);
+    }
+
+    if (full_repaint) {
+        repaint_static_layer(lp, layer_rect, layer_rect);
+    } else {
+        for (int idx : static_layer_dirty) {
+            int x, y;
+            to_grid_xy(idx, &x, &y);
+
+            // pad by a pixel so that every pixel touched by the cell is repainted
+            QRectF r = get_screen_rect(x, y + 1, 1, 1, RENDER_EPS);
+            int x0 = (int)floor(r.x()) - 1;
+            int y0 = (int)floor(r.y()) - 1;
+            int x1 = (int)ceil(r.x() + r.width()) + 1;
+            int y1 = (int)ceil(r.y() + r.height()) + 1;
+            QRect region = QRect(x0, y0, x1 - x0, y1 - y0).intersected(layer_rect);
+
+            if (!region.isEmpty()) {
+                repaint_static_layer(lp, layer_rect, region);
+            }
+        }
+    }
+
+    if (lp.isActive()) {
+        lp.end();
     }
+
+    std::swap(rasterizer, static_layer_rasterizer);
+
+    x_off = frame_x_off;
+    y_off = frame_y_off;
+
+    static_layer_dirty.clear();
+    static_layer_valid = true;
+
+    return true;
+}
+
+/*
+  Repaint everything below the dynamic entities within region, drawing the same things in the same order
+  as draw_background() and draw_foreground() so that the result matches a full repaint exactly.
+*/
+void BasicAbstractGame::repaint_static_layer(QPainter &p, const QRect &rect, const QRect &region) {
+    bool clipped = region != rect;
+
+    if (clipped) {
+        if (options.renderer == NativeRenderer) {
+            rasterizer.set_clip(region);
+        } else {
+            p.setClipRect(region);
+        }
+    }
+
+    fill_rect(p, rect, QColor(0, 0, 0));
+    draw_background_image(p);
+    draw_entities(p, entities, -1);
+
+    int low_x = static_layer_low_x;
+    int high_x = static_layer_high_x;
+    int low_y = static_layer_low_y;
+    int high_y = static_layer_high_y;
+
+    if (clipped) {
+        // only cells that can touch the region need to be drawn, screen y increases as world y decreases
+        int region_low_x = (int)floor((region.x() + x_off) / unit) - 1;
+        int region_high_x = (int)floor((region.x() + region.width() + x_off) / unit) + 1;
+        int region_low_y = (int)floor(view_dim - (region.y() + region.height() - y_off) / unit) - 1;
+        int region_high_y = (int)floor(view_dim - (region.y() - y_off) / unit) + 1;
+
+        low_x = std::max(low_x, region_low_x);
+        high_x = std::min(high_x, region_high_x);
+        low_y = std::max(low_y, region_low_y);
+        high_y = std::min(high_y, region_high_y);
+    }
+
+    draw_grid(p, low_x, high_x, low_y, high_y);
 }
 
 void BasicAbstractGame::set_pen_brush_color(QPainter &p, QColor color, int thickness) {
+    // consecutive shapes often share a color, so skip creating a new pen and brush when nothing changed
+    if (pen_brush_painter == &p && pen_brush_color == color && pen_brush_thickness == thickness) {
+        return;
+    }
+
     QBrush brush(color);
     QPen pen(color, thickness);
     p.setBrush(brush);
     p.setPen(pen);
+
+    pen_brush_painter = &p;
+    pen_brush_color = color;
+    pen_brush_thickness = thickness;
+}
+
+void BasicAbstractGame::fill_rect(QPainter &p, const QRectF &rect, const QColor &color) {
+    if (options.renderer == NativeRenderer) {
+        rasterizer.fill_rect(rect, color);
+    } else {
+        p.fillRect(rect, color);
+    }
+}
+
+/*
+  Draw a filled ellipse, thickness > 0 also draws an outline of the same color.
+*/
+void BasicAbstractGame::draw_ellipse(QPainter &p, const QRectF &rect, const QColor &color, int thickness) {
+    if (options.renderer == NativeRenderer) {
+        rasterizer.fill_ellipse(rect, color, thickness);
+    } else {
+        if (thickness > 0) {
+            set_pen_brush_color(p, color, thickness);
+        } else {
+            p.setBrush(color);
+            p.setPen(Qt::NoPen);
+            pen_brush_painter = nullptr;
+        }
+        p.drawEllipse(rect);
+    }
+}
+
+void BasicAbstractGame::draw_line(QPainter &p, int x1, int y1, int x2, int y2, const QColor &color, int thickness) {
+    if (options.renderer == NativeRenderer) {
+        rasterizer.draw_line(x1, y1, x2, y2, color, thickness);
+    } else {
+        set_pen_brush_color(p, color, thickness);
+        p.drawLine(x1, y1, x2, y2);
+    }
 }
 
 void BasicAbstractGame::draw_background(QPainter &p, const QRect &rect) {
-    p.fillRect(rect, QColor(0, 0, 0));
+    fill_rect(p, rect, QColor(0, 0, 0));
 
     prepare_for_drawing(rect.height());
+    draw_background_image(p);
+}
 
+void BasicAbstractGame::draw_background_image(QPainter &p) {
     if (!options.use_backgrounds) {
         return;
     }
@@ -1002,11 +1553,30 @@ void BasicAbstractGame::draw_background(QPainter &p, const QRect &rect) {
         float offset_x = bg_pct_x * extra_w;
 
         QRectF bg_rect = adjust_rect(main_rect, QRectF(-offset_x, 0, bg_ar / world_ar, 1));
-        p.drawImage(bg_rect, *background_image);
+        draw_scaled_image(p, bg_rect, *background_image);
     }
 }
 
 void BasicAbstractGame::game_draw(QPainter &p, const QRect &rect) {
+    // the painter state is reset between frames
+    pen_brush_painter = nullptr;
+
+    if (should_use_static_layer(rect)) {
+        prepare_for_drawing(rect.height());
+
+        QPoint origin;
+        if (update_static_layer(rect, &origin)) {
+            if (options.renderer == NativeRenderer) {
+                rasterizer.blit(-origin.x(), -origin.y(), static_layer);
+            } else {
+                p.drawImage(QPoint(-origin.x(), -origin.y()), static_layer);
+            }
+
+            draw_dynamic_layers(p, rect);
+            return;
+        }
+    }
+
     draw_background(p, rect);
     draw_foreground(p, rect);
 }
@@ -1086,17 +1656,51 @@ bool BasicAbstractGame::is_out_of_bounds(const std::shared_ptr<Entity> &e1) {
 void BasicAbstractGame::step_entities(const std::vector<std::shared_ptr<Entity>> &given) {
     int entities_count = (int)(given.size());
 
+    // stepping an entity only moves that entity, so the grid can be kept up to date as we go
+    bool use_grid = &given == &entities && should_use_entity_grid();
+    bool use_sweep = &given == &entities && !use_grid && entities_count >= options.sweep_min_entities;
+    if (use_grid) {
+        build_entity_grid();
+        entity_grid_active = true;
+    } else if (use_sweep) {
+        sweep.build(entities);
+    }
+
     for (int i = entities_count - 1; i >= 0; i--) {
-        auto ent = given.at(i);
+        const auto &ent = given[i];
+
+        if (use_sweep) {
+            sweep_idx = i;
+        }
 
         if (ent->smart_step) {
             basic_step_object(ent);
         }
 
         ent->step();
+
+        if (use_grid) {
+            entity_grid.update(i);
+        } else if (use_sweep && !sweep.contains(i, *ent)) {
+            sweep.mark_escaped(i);
+        }
+    }
+
+    if (use_grid) {
+        entity_grid_active = false;
+    } else if (use_sweep) {
+        sweep_idx = -1;
     }
 }
 
+bool BasicAbstractGame::should_use_entity_grid() {
+    return (int)(entities.size()) >= options.entity_grid_min_entities;
+}
+
+void BasicAbstractGame::build_entity_grid() {
+    entity_grid.build(entities, main_width, main_height);
+}
+
 float BasicAbstractGame::rand_pos(float r, float min, float max) {
     fassert(min <= max);
 
@@ -1112,8 +1716,22 @@ float BasicAbstractGame::rand_pos(float r, float max) {
 }
 
 bool BasicAbstractGame::has_any_collision(const std::shared_ptr<Entity> &e1, float margin) {
+    if (entity_grid_active) {
+        entity_grid.query(e1->x, e1->y, e1->rx + margin, e1->ry + margin, (int)(entities.size()), &nearby_candidates);
+
+        for (int i : nearby_candidates) {
+            const auto &ent = entities[i];
+
+            if (!ent->avoids_collisions && has_collision(e1, ent, margin)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     for (int i = (int)(entities.size()) - 1; i >= 0; i--) {
-        auto ent = entities.at(i);
+        const auto &ent = entities[i];
 
         if (!ent->avoids_collisions && has_collision(e1, ent, margin)) {
             return true;
@@ -1160,7 +1778,7 @@ void BasicAbstractGame::write_entities(WriteBuffer *b, std::vector<std::shared_p
 void BasicAbstractGame::read_entities(ReadBuffer *b, std::vector<std::shared_ptr<Entity>> &ents) {
     ents.resize(b->read_int());
     for (size_t i = 0; i < ents.size(); i++) {
-        auto e = std::make_shared<Entity>();
+        auto e = make_entity();
         e->deserialize(b);
         ents[i] = e;
     }
@@ -1178,6 +1796,7 @@ void BasicAbstractGame::serialize(WriteBuffer *b) {
 //     std::vector<std::shared_ptr<QImage>> basic_assets;
 //     std::vector<std::shared_ptr<QImage>> basic_reflections;
 //     std::vector<std::shared_ptr<QImage>> *main_bg_images_ptr;
+//     std::unordered_map<uint64_t, std::shared_ptr<QImage>> scaled_assets;
 
     // std::vector<float> asset_aspect_ratios;
     // std::vector<int> asset_num_themes;
@@ -1285,4 +1904,5 @@ void BasicAbstractGame::deserialize(ReadBuffer *b) {
     min_visibility = b->read_float();
 
     grid.deserialize(b);
+    static_layer_valid = false;
 }
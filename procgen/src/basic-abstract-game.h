@@ -9,8 +9,12 @@ Base game class used by all currently existing games
 #include <string>
 #include <set>
 #include <queue>
+#include <unordered_map>
 #include "game.h"
 #include "grid.h"
+#include "entity-grid.h"
+#include "entity-pool.h"
+#include "sweep-and-prune.h"
 #include "cpp-utils.h"
 
 class BasicAbstractGame : public Game {
@@ -60,7 +64,16 @@ class BasicAbstractGame : public Game {
     void decay_agent_velocity();
     void tile_image(QPainter &p, std::shared_ptr<QImage> image, QRectF &rect, float tile_ratio);
     void set_pen_brush_color(QPainter &p, QColor color, int thickness = 1);
+    void fill_rect(QPainter &p, const QRectF &rect, const QColor &color);
+    void draw_ellipse(QPainter &p, const QRectF &rect, const QColor &color, int thickness = 0);
+    void draw_line(QPainter &p, int x1, int y1, int x2, int y2, const QColor &color, int thickness = 1);
     void basic_step_object(const std::shared_ptr<Entity> &obj);
+    // entities should be created with this instead of make_shared or new, see entity-pool.h
+    template <typename... Args>
+    std::shared_ptr<Entity> make_entity(Args &&... args) {
+        return std::allocate_shared<Entity>(EntityAllocator<Entity>(&entity_pool), std::forward<Args>(args)...);
+    }
+
     std::shared_ptr<Entity> spawn_entity_rxy(float rx, float ry, int type, float x, float y, float w, float h, bool check_collisions = true);
     std::shared_ptr<Entity> spawn_entity(float r, int type, float x, float y, float w, float h, bool check_collisions = true);
     std::shared_ptr<Entity> spawn_entity_at_idx(int idx, float r, int type);
@@ -80,13 +93,13 @@ class BasicAbstractGame : public Game {
     int get_agent_index();
     std::vector<int> get_cells_with_type(int type);
 
-    void check_grid_collisions(const std::shared_ptr<Entity> &src);
+    bool check_grid_collisions(const std::shared_ptr<Entity> &src);
     float get_distance(const std::shared_ptr<Entity> &p0, const std::shared_ptr<Entity> &p1);
     void match_aspect_ratio(const std::shared_ptr<Entity> &ent, bool match_width = true);
     void fit_aspect_ratio(const std::shared_ptr<Entity> &ent);
     void choose_random_theme(const std::shared_ptr<Entity> &ent);
     int mask_theme_if_necessary(int theme, int type);
-    void tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio);
+    void tile_image(QPainter &p, QImage *image, const QRectF &rect, float tile_ratio, int img_idx = -1, bool is_reflected = false);
 
     float rand_pos(float r, float max);
     float rand_pos(float r, float min, float max);
@@ -158,17 +171,80 @@ class BasicAbstractGame : public Game {
     float visibility = 0.0f;
     float min_visibility = 0.0f;
 
+    // cache the background, grid and entities with render_z == -1 in a layer that is only repainted where cells change,
+    // games should only enable this if grid cells are drawn the same way for the whole level
+    bool use_static_layer = false;
+
   private:
     Grid<int> grid;
 
+    // assets resampled to the pixel size they are drawn at, keyed by scaled_asset_key()
+    std::unordered_map<uint64_t, std::shared_ptr<QImage>> scaled_assets;
+
+    // image of everything drawn below the dynamic entities, see update_static_layer()
+    QImage static_layer;
+    Rasterizer static_layer_rasterizer;
+    bool static_layer_valid = false;
+    RenderBackend static_layer_renderer = QtRenderer;
+    QSize static_layer_size;
+    float static_layer_unit = 0.0f;
+    float static_layer_x_off = 0.0f;
+    float static_layer_y_off = 0.0f;
+    int static_layer_low_x = 0;
+    int static_layer_high_x = 0;
+    int static_layer_low_y = 0;
+    int static_layer_high_y = 0;
+    float static_layer_last_phase_x = 0.0f;
+    float static_layer_last_phase_y = 0.0f;
+    // number of frames in a row the camera phase hasn't changed
+    int static_layer_stable_frames = 0;
+    std::vector<float> static_layer_ents;
+    std::vector<float> static_layer_ents_next;
+    std::vector<int> static_layer_dirty;
+
+    // the painter whose pen and brush were last set by set_pen_brush_color, null if they may have changed since
+    QPainter *pen_brush_painter = nullptr;
+    QColor pen_brush_color;
+    int pen_brush_thickness = 0;
+
+    // outlives the entities since the destructor clears them, see entity-pool.h
+    EntityPool entity_pool;
+
+    // broadphase for collisions between entities, the collision checks only use it while
+    // entity_grid_active is set since game code can move entities without updating it
+    EntityGrid entity_grid;
+    bool entity_grid_active = false;
+    // used instead of the grid by sub_step() while step_entities() steps fewer entities, sweep_idx is the
+    // index of the entity being stepped, -1 if none
+    SweepAndPrune sweep;
+    int sweep_idx = -1;
+    // one buffer per push_obj() depth, since sub_step() recurses while iterating over candidates
+    std::vector<int> sub_step_candidates[6];
+    std::vector<int> collision_candidates;
+    std::vector<int> nearby_candidates;
+
     QImage *lookup_asset(int img_idx, bool is_reflected = false);
+    QImage *lookup_scaled_asset(int img_idx, bool is_reflected, int w, int h);
     void initialize_asset_if_necessary(int img_idx);
     void prepare_for_drawing(float rect_height);
     void draw_background(QPainter &p, const QRect &rect);
+    void draw_background_image(QPainter &p);
+    void get_visible_cells(int &low_x, int &high_x, int &low_y, int &high_y);
+    void draw_grid(QPainter &p, int low_x, int high_x, int low_y, int high_y);
+    void draw_dynamic_layers(QPainter &p, const QRect &rect);
+    bool should_use_static_layer(const QRect &rect);
+    void mark_cell_dirty(int idx);
+    void layout_static_layer(const QRect &rect);
+    bool locate_in_static_layer(const QRect &rect, QPoint *origin);
+    bool update_static_layer(const QRect &rect, QPoint *origin);
+    void repaint_static_layer(QPainter &p, const QRect &rect, const QRect &region);
     void draw_entity(QPainter &p, const std::shared_ptr<Entity> &to_draw);
     void draw_entities(QPainter &p, const std::vector<std::shared_ptr<Entity>> &to_draw, int render_z = 0);
     void draw_image(QPainter &p, QRectF &rect, float rotation, bool is_reflected, int img_idx, int theme, float alpha, float tile_ratio);
+    void draw_scaled_image(QPainter &p, const QRectF &rect, const QImage &image, int img_idx = -1, bool is_reflected = false);
 
     bool sub_step(const std::shared_ptr<Entity> &obj, float _vx, float _vy, int depth);
     bool should_erase(const std::shared_ptr<Entity> &e1);
+    bool should_use_entity_grid();
+    void build_entity_grid();
 };
@@ -3,6 +3,8 @@
 #include "cpp-utils.h"
 #include <vector>
 #include <string>
+#include <cstring>
+#include <cstdint>
 
 struct ReadBuffer {
     char *data = nullptr;
@@ -41,6 +43,15 @@ struct ReadBuffer {
         return v;
     };
 
+    std::vector<uint8_t> read_vector_uint8() {
+        std::vector<uint8_t> v;
+        v.resize(read_int());
+        fassert(offset + v.size() <= length);
+        memcpy(v.data(), &data[offset], v.size());
+        offset += v.size();
+        return v;
+    };
+
     float read_float() {
         fassert(offset + sizeof(float) <= length);
         auto d = (float*)(&data[offset]);
@@ -105,6 +116,13 @@ struct WriteBuffer {
         }
     };
 
+    void write_vector_uint8(const std::vector<uint8_t>& v) {
+        write_int(v.size());
+        fassert(offset + v.size() <= length);
+        memcpy(&data[offset], v.data(), v.size());
+        offset += v.size();
+    };
+
     void write_float(float f) {
         fassert(offset + sizeof(float) <= length);
         auto d = (float*)(&data[offset]);
@@ -0,0 +1,83 @@
+#include "cpu-affinity.h"
+#include "cpp-utils.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+std::vector<int> parse_cpu_list(const std::string &s) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+
+    while (pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) {
+            end = s.size();
+        }
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+
+        // ignore whitespace such as the trailing newline in sysfs files
+        item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if (item.empty()) {
+            continue;
+        }
+
+        int low, high;
+        size_t dash = item.find('-');
+        if (dash == std::string::npos) {
+            low = high = std::stoi(item);
+        } else {
+            low = std::stoi(item.substr(0, dash));
+            high = std::stoi(item.substr(dash + 1));
+        }
+
+        if (low < 0 || high < low) {
+            fatal("invalid cpu list %s\n", s.c_str());
+        }
+
+#ifdef __linux__
+        // cpu_set_t can't hold larger cpu numbers
+        if (high >= CPU_SETSIZE) {
+            fatal("cpu %d in cpu list %s is out of range, the largest supported cpu is %d\n", high, s.c_str(), CPU_SETSIZE - 1);
+        }
+#endif
+
+        for (int cpu = low; cpu <= high; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+std::vector<int> numa_node_cpus(int node) {
+    std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    std::ifstream f(path);
+    if (!f) {
+        fatal("could not find cpus for numa node %d in %s\n", node, path.c_str());
+    }
+
+    std::string contents;
+    std::getline(f, contents);
+    return parse_cpu_list(contents);
+}
+
+bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        fatal("failed to pin thread to cpu %d, error %d\n", cpu, err);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+
+Helpers for pinning threads to CPUs, used to keep each stepping thread and the games it touches on one core
+
+*/
+
+#include <string>
+#include <vector>
+
+// parse a list like "0-3,8,10-11" into CPU indices
+std::vector<int> parse_cpu_list(const std::string &s);
+
+// CPUs that belong to a NUMA node according to sysfs
+std::vector<int> numa_node_cpus(int node);
+
+// returns false if the current platform doesn't support pinning threads
+bool pin_current_thread(int cpu);
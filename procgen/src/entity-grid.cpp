@@ -0,0 +1,193 @@
+#include "entity-grid.h"
+#include <algorithm>
+#include <cmath>
+
+// added to every box so that float rounding can't make a colliding pair land in cells that don't overlap
+const float SPAN_PADDING = 0.01f;
+// entities covering more cells than this go in the oversized list
+const int MAX_SPAN_CELLS = 64;
+
+static int clamp_cell(float v, int size) {
+    return (int)(fminf(fmaxf(floorf(v), 0.0f), (float)(size - 1)));
+}
+
+EntityGrid::Span EntityGrid::span_for(float x, float y, float rx, float ry) const {
+    Span span = {-1, -1, -1, -1};
+    float x0 = x - rx - SPAN_PADDING;
+    float x1 = x + rx + SPAN_PADDING;
+    float y0 = y - ry - SPAN_PADDING;
+    float y1 = y + ry + SPAN_PADDING;
+    if (!std::isfinite(x0) || !std::isfinite(x1) || !std::isfinite(y0) || !std::isfinite(y1)) {
+        return span;
+    }
+
+    // anything outside of the world goes in the border cells, clamp before converting so that far away
+    // coordinates can't overflow
+    span.x0 = clamp_cell(x0, w);
+    span.x1 = clamp_cell(x1, w);
+    span.y0 = clamp_cell(y0, h);
+    span.y1 = clamp_cell(y1, h);
+    return span;
+}
+
+void EntityGrid::build(const std::vector<std::shared_ptr<Entity>> &_entities, int width, int height) {
+    entities = &_entities;
+    count = (int)(entities->size());
+
+    if (w != width || h != height) {
+        w = width;
+        h = height;
+        cells.clear();
+        cells.resize(w * h);
+    } else {
+        for (int cell : used_cells) {
+            cells[cell].clear();
+        }
+    }
+    used_cells.clear();
+    oversized.clear();
+    spans.resize(count);
+    box_x.resize(count);
+    box_y.resize(count);
+    box_rx.resize(count);
+    box_ry.resize(count);
+
+    max_collision_margin = 0.0f;
+    for (int i = 0; i < count; i++) {
+        max_collision_margin = std::max(max_collision_margin, (*entities)[i]->collision_margin);
+        store_box(i);
+        insert(i);
+    }
+}
+
+void EntityGrid::store_box(int idx) {
+    const Entity &ent = *(*entities)[idx];
+    box_x[idx] = ent.x;
+    box_y[idx] = ent.y;
+    box_rx[idx] = ent.rx;
+    box_ry[idx] = ent.ry;
+}
+
+void EntityGrid::insert(int idx) {
+    const Entity &ent = *(*entities)[idx];
+    Span span = span_for(ent.x, ent.y, ent.rx, ent.ry);
+    if (span.x0 >= 0 && (span.x1 - span.x0 + 1) * (span.y1 - span.y0 + 1) > MAX_SPAN_CELLS) {
+        span.x0 = -1;
+    }
+    spans[idx] = span;
+
+    if (span.x0 < 0) {
+        oversized.push_back(idx);
+        return;
+    }
+
+    for (int y = span.y0; y <= span.y1; y++) {
+        for (int x = span.x0; x <= span.x1; x++) {
+            auto &cell = cells[y * w + x];
+            if (cell.empty()) {
+                used_cells.push_back(y * w + x);
+            }
+            cell.push_back(idx);
+        }
+    }
+}
+
+void EntityGrid::remove(int idx) {
+    const Span &span = spans[idx];
+
+    if (span.x0 < 0) {
+        oversized.erase(std::find(oversized.begin(), oversized.end(), idx));
+        return;
+    }
+
+    for (int y = span.y0; y <= span.y1; y++) {
+        for (int x = span.x0; x <= span.x1; x++) {
+            // the order within a cell doesn't matter since queries sort their results
+            auto &cell = cells[y * w + x];
+            auto pos = std::find(cell.begin(), cell.end(), idx);
+            *pos = cell.back();
+            cell.pop_back();
+        }
+    }
+}
+
+void EntityGrid::update(int idx) {
+    if (idx >= count) {
+        return;
+    }
+
+    store_box(idx);
+
+    const Entity &ent = *(*entities)[idx];
+    Span span = span_for(ent.x, ent.y, ent.rx, ent.ry);
+    const Span &old = spans[idx];
+    if (old.x0 >= 0 && span.x0 == old.x0 && span.x1 == old.x1 && span.y0 == old.y0 && span.y1 == old.y1) {
+        return;
+    }
+
+    remove(idx);
+    insert(idx);
+}
+
+void EntityGrid::query(float x, float y, float rx, float ry, int limit, std::vector<int> *out) {
+    out->clear();
+
+    // entities added since build() aren't in the grid
+    int total = std::min((int)(entities->size()), limit);
+    for (int i = count; i < total; i++) {
+        out->push_back(i);
+    }
+
+    if ((int)(query_marks.size()) < count) {
+        query_marks.resize(count, 0);
+    }
+    query_mark++;
+    if (query_mark == 0) {
+        std::fill(query_marks.begin(), query_marks.end(), 0);
+        query_mark = 1;
+    }
+
+    auto add = [&](int idx) {
+        if (idx < limit && query_marks[idx] != query_mark) {
+            query_marks[idx] = query_mark;
+            out->push_back(idx);
+        }
+    };
+
+    for (int idx : oversized) {
+        add(idx);
+    }
+
+    rx = std::max(rx, 0.0f);
+    ry = std::max(ry, 0.0f);
+    Span span = span_for(x, y, rx, ry);
+    if (span.x0 < 0) {
+        for (int i = 0; i < std::min(count, limit); i++) {
+            add(i);
+        }
+    } else {
+        size_t first = out->size();
+        for (int cy = span.y0; cy <= span.y1; cy++) {
+            for (int cx = span.x0; cx <= span.x1; cx++) {
+                for (int idx : cells[cy * w + cx]) {
+                    add(idx);
+                }
+            }
+        }
+
+        // drop the candidates whose boxes don't overlap, this is written without branches over the stored
+        // boxes so that it doesn't have to touch the entities, the padding keeps it from dropping an entity
+        // that the exact check would find colliding because of rounding
+        int *candidates = out->data();
+        size_t kept = first;
+        for (size_t k = first; k < out->size(); k++) {
+            int idx = candidates[k];
+            bool overlaps = (fabsf(x - box_x[idx]) < rx + box_rx[idx] + SPAN_PADDING) & (fabsf(y - box_y[idx]) < ry + box_ry[idx] + SPAN_PADDING);
+            candidates[kept] = idx;
+            kept += overlaps;
+        }
+        out->resize(kept);
+    }
+
+    std::sort(out->begin(), out->end(), [](int a, int b) { return a > b; });
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+
+Broadphase for collisions between entities
+
+Entities are bucketed into the cells of a uniform grid with one cell per world unit, the same cells the
+games use for their Grid, so a collision check only has to look at the entities in nearby cells instead of
+at every entity. Queries return candidates in decreasing index order, which is the order the collision
+loops visit entities in, so using the grid doesn't change what the games do.
+
+The boxes of the indexed entities are also kept in separate arrays, so that candidates from the cells that
+can't overlap the query box are dropped without touching the entities themselves.
+
+The grid only knows where entities were when they were added, the caller has to call update() after an
+entity moves or build() again after it can't tell which entities moved.
+
+*/
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "entity.h"
+
+class EntityGrid {
+  public:
+    // index the entities, the vector may grow while the grid is in use but existing entries must stay in place
+    void build(const std::vector<std::shared_ptr<Entity>> &entities, int width, int height);
+    // call after entity idx moved or changed size
+    void update(int idx);
+
+    // fill out with the indices below limit of the entities that may overlap the box with half extents rx and ry
+    // around (x, y), in decreasing order, entities added to the vector after build() are always included
+    void query(float x, float y, float rx, float ry, int limit, std::vector<int> *out);
+
+    // the largest collision margin of the indexed entities, at least 0
+    float max_collision_margin = 0.0f;
+
+  private:
+    // range of cells an entity was added to, x0 < 0 if it's in the oversized list instead
+    struct Span {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    const std::vector<std::shared_ptr<Entity>> *entities = nullptr;
+    int w = 0;
+    int h = 0;
+    // number of entities that were indexed by build()
+    int count = 0;
+    std::vector<std::vector<int>> cells;
+    // cells that may be non-empty, so that build() doesn't have to clear every cell
+    std::vector<int> used_cells;
+    std::vector<Span> spans;
+    // box of each indexed entity as of its last build() or update()
+    std::vector<float> box_x;
+    std::vector<float> box_y;
+    std::vector<float> box_rx;
+    std::vector<float> box_ry;
+    // entities that would cover too many cells or have non-finite coordinates, they match every query
+    std::vector<int> oversized;
+    // marks entities already added to the current query result
+    std::vector<uint32_t> query_marks;
+    uint32_t query_mark = 0;
+
+    Span span_for(float x, float y, float rx, float ry) const;
+    void store_box(int idx);
+    void insert(int idx);
+    void remove(int idx);
+};
@@ -0,0 +1,42 @@
+#include "entity-pool.h"
+#include "cpp-utils.h"
+
+EntityPool::~EntityPool() {
+    // an entity outliving its pool would later return its block to freed memory
+    fassert(num_allocated == 0);
+
+    for (auto &free_list : free_lists) {
+        for (void *block : free_list.blocks) {
+            ::operator delete(block);
+        }
+    }
+}
+
+EntityPool::FreeList &EntityPool::free_list_for(size_t size) {
+    for (auto &free_list : free_lists) {
+        if (free_list.size == size) {
+            return free_list;
+        }
+    }
+
+    free_lists.push_back(FreeList{size, {}});
+    return free_lists.back();
+}
+
+void *EntityPool::allocate(size_t size) {
+    auto &free_list = free_list_for(size);
+    num_allocated++;
+
+    if (free_list.blocks.empty()) {
+        return ::operator new(size);
+    }
+
+    void *block = free_list.blocks.back();
+    free_list.blocks.pop_back();
+    return block;
+}
+
+void EntityPool::deallocate(void *p, size_t size) {
+    num_allocated--;
+    free_list_for(size).blocks.push_back(p);
+}
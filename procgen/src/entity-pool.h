@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+
+Recycles the memory of entities for a single game
+
+Games spawn and erase bullets, explosions and the like every few steps, each one used to be a separate heap
+allocation. Entities made with BasicAbstractGame::make_entity() have their shared_ptr control block and the
+entity itself allocated from a per-game free list instead, so once a game has reached its usual number of
+entities spawning doesn't allocate anymore.
+
+The pool isn't thread safe, it relies on a game only being used by one thread at a time. Allocators only
+point at the pool, so that making or destroying an entity doesn't touch a reference count, which means every
+entity must be destroyed before the pool, the owning game clears its entities before destroying its pool.
+
+*/
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class EntityPool {
+  public:
+    ~EntityPool();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+  private:
+    // number of blocks handed out and not returned yet
+    size_t num_allocated = 0;
+
+    struct FreeList {
+        size_t size;
+        std::vector<void *> blocks;
+    };
+
+    // allocate_shared() only ever asks for one or two different sizes, so a linear search is fine
+    std::vector<FreeList> free_lists;
+
+    FreeList &free_list_for(size_t size);
+};
+
+template <typename T>
+class EntityAllocator {
+  public:
+    using value_type = T;
+
+    explicit EntityAllocator(EntityPool *_pool) : pool(_pool) {
+    }
+
+    template <typename U>
+    EntityAllocator(const EntityAllocator<U> &other) : pool(other.pool) {
+    }
+
+    T *allocate(size_t n) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over aligned types are not supported");
+        if (n != 1) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(pool->allocate(sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        pool->deallocate(p, sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const EntityAllocator<U> &other) const {
+        return pool == other.pool;
+    }
+
+    template <typename U>
+    bool operator!=(const EntityAllocator<U> &other) const {
+        return pool != other.pool;
+    }
+
+  private:
+    template <typename U>
+    friend class EntityAllocator;
+
+    EntityPool *pool;
+};
@@ -6,6 +6,7 @@
 
 class Entity {
   public:
+    // the fields read by the collision checks come first so that they share a cache line
     float x = 0.0f;
     float y = 0.0f;
     float vx = 0.0f;
@@ -13,6 +14,12 @@ class Entity {
     float rx = 0.0f;
     float ry = 0.0f; 
     int type = 0;
+    float collision_margin = 0.0f;
+    bool will_erase = false;
+    bool collides_with_entities = false;
+    bool smart_step = false;
+    bool avoids_collisions = false;
+
     int image_type = 0;
     int image_theme = 0;
 
@@ -22,9 +29,6 @@ class Entity {
     // -1: render below grid objects
     int render_z = 0;
 
-    bool will_erase = false;
-    bool collides_with_entities = false;
-    float collision_margin = 0.0f;
     float rotation = 0.0f;
     float vrot = 0.0f;
     bool is_reflected = false;
@@ -35,8 +39,6 @@ class Entity {
     bool use_abs_coords = false;
 
     float friction = 0.0f;
-    bool smart_step = false;
-    bool avoids_collisions = false;
     bool auto_erase = false;
 
     // often not used
@@ -1,26 +1,13 @@
 
 #include "game.h"
 #include "vecoptions.h"
+#include <algorithm>
 
 // this should be updated whenever the state format or environments may have changed
 const int SERIALIZE_VERSION = 0;
-
-void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h) {
-    uint8_t *src = (uint8_t *)src_bgr32;
-    uint8_t *dst = (uint8_t *)dst_rgb888;
-
-    for (int y = 0; y < h; y++) {
-        uint8_t *s = src + y * w * 4;
-        uint8_t *d = dst + y * w * 3;
-        for (int x = 0; x < w; x++) {
-            d[0] = s[2];
-            d[1] = s[1];
-            d[2] = s[0];
-            s += 4;
-            d += 3;
-        }
-    }
-}
+// states of games with frame_stack > 1 also contain the stacked frames, games without a stack keep writing
+// the original format so that their states stay compatible
+const int SERIALIZE_VERSION_FRAME_STACK = 1;
 
 Game::Game(std::string name) : game_name(name) {
     timeout = 1000;
@@ -49,6 +36,28 @@ void Game::parse_options(std::string name, VecOptions opts) {
     opts.consume_bool("center_agent", &options.center_agent);
     opts.consume_bool("use_sequential_levels", &options.use_sequential_levels);
 
+    std::string renderer = "qt";
+    opts.consume_string("renderer", &renderer);
+    if (renderer == "qt") {
+        options.renderer = QtRenderer;
+    } else if (renderer == "native") {
+        options.renderer = NativeRenderer;
+    } else {
+        fatal("invalid renderer %s\n", renderer.c_str());
+    }
+
+    opts.consume_int("action_repeat", &options.action_repeat);
+    fassert(options.action_repeat >= 1);
+    opts.consume_bool("max_pool_frames", &options.max_pool_frames);
+    if (options.max_pool_frames) {
+        pool_buf.resize(RES_W * RES_H);
+    }
+
+    opts.consume_bool("cache_scaled_assets", &options.cache_scaled_assets);
+    opts.consume_bool("cache_static_layer", &options.cache_static_layer);
+    opts.consume_int("entity_grid_min_entities", &options.entity_grid_min_entities);
+    opts.consume_int("sweep_min_entities", &options.sweep_min_entities);
+
     int dist_mode = EasyMode;
     opts.consume_int("distribution_mode", &dist_mode);
     options.distribution_mode = static_cast<DistributionMode>(dist_mode);
@@ -74,20 +83,107 @@ void Game::parse_options(std::string name, VecOptions opts) {
     opts.ensure_empty();
 }
 
+static size_t observation_frame_size(const std::string &name) {
+    if (name == "rgb") {
+        return RES_W * RES_H * 3;
+    } else if (name == "gray") {
+        return RES_W * RES_H;
+    } else if (name == "rgb_32") {
+        return (RES_W / 2) * (RES_H / 2) * 3;
+    }
+    fatal("invalid observation space %s\n", name.c_str());
+    return 0;
+}
+
+void Game::set_observation_spaces(const std::vector<std::string> &names, int frame_stack) {
+    fassert(frame_stack >= 1);
+    fassert(names.size() > 0);
+    options.frame_stack = frame_stack;
+
+    obs_name_to_offset.clear();
+    obs_frame_offsets.clear();
+    obs_frame_sizes.clear();
+    size_t frame_size = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+        obs_name_to_offset[names[i]] = i;
+        obs_frame_offsets.push_back(frame_size);
+        obs_frame_sizes.push_back(observation_frame_size(names[i]));
+        frame_size += obs_frame_sizes.back();
+    }
+
+    frame_stack_pos = 0;
+    frame_stack_buf.clear();
+    if (frame_stack > 1) {
+        frame_stack_buf.resize(frame_stack * frame_size);
+    }
+}
+
 void Game::render_to_buf(void *dst, int w, int h, bool antialias) {
+    QRect rect = QRect(0, 0, w, h);
+    render_antialiased = antialias;
+
+    if (options.renderer == NativeRenderer) {
+        // all drawing goes through the rasterizer, so the painter is never activated
+        rasterizer.begin((uint32_t *)dst, w, h, antialias);
+        QPainter p;
+        game_draw(p, rect);
+        return;
+    }
+
     // Qt focuses on RGB32 performance:
     // https://doc.qt.io/qt-5/qpainter.html#performance
     // so render to an RGB32 buffer and then convert it rather than render to RGB888 directly
-    QImage img((uchar *)dst, w, h, w * 4, QImage::Format_RGB32);
-    QPainter p(&img);
+    if (dst != render_buf && dst != pool_buf.data()) {
+        // buffers we don't own may go away, so don't keep a painter on them
+        QImage img((uchar *)dst, w, h, w * 4, QImage::Format_RGB32);
+        QPainter p(&img);
+        set_render_hints(p, antialias);
+        game_draw(p, rect);
+        return;
+    }
+
+    QPainter &p = get_render_painter(dst, w, h, antialias);
+    // drawing may change the painter state, so put it back for the next frame
+    p.save();
+    game_draw(p, rect);
+    p.restore();
+}
 
+void Game::set_render_hints(QPainter &p, bool antialias) {
     if (antialias) {
         p.setRenderHint(QPainter::Antialiasing, true);
         p.setRenderHint(QPainter::SmoothPixmapTransform, true);
     }
+}
 
-    QRect rect = QRect(0, 0, w, h);
-    game_draw(p, rect);
+QPainter &Game::get_render_painter(void *dst, int w, int h, bool antialias) {
+    render_context_uses++;
+
+    RenderContext *ctx = &render_contexts[0];
+    for (auto &c : render_contexts) {
+        if (c.buf == dst && c.w == w && c.h == h && c.antialias == antialias) {
+            c.last_used = render_context_uses;
+            return *c.painter;
+        }
+        if (c.last_used < ctx->last_used) {
+            ctx = &c;
+        }
+    }
+
+    // replace the least recently used context
+    ctx->painter.reset();
+    ctx->buf = dst;
+    ctx->w = w;
+    ctx->h = h;
+    ctx->antialias = antialias;
+    ctx->last_used = render_context_uses;
+
+    ctx->img.reset(new QImage((uchar *)dst, w, h, w * 4, QImage::Format_RGB32));
+    ctx->painter.reset(new QPainter(ctx->img.get()));
+
+    set_render_hints(*ctx->painter, antialias);
+
+    return *ctx->painter;
 }
 
 void Game::reset() {
@@ -117,7 +213,49 @@ void Game::reset() {
     action = default_action;
 }
 
+/*
+  Advance the game by one agent decision, which is options.action_repeat game steps unless an episode ends first.
+  Only the final frame is rendered, rewards are summed over the repeated steps.
+*/
 void Game::step() {
+    float reward = 0;
+    bool level_complete = false;
+    pool_observation = false;
+
+    for (int i = 0; i < options.action_repeat; i++) {
+        step_frame();
+        reward += step_data.reward;
+        level_complete = level_complete || step_data.level_complete;
+
+        if (step_data.done) {
+            // the frame after an episode ends belongs to the next episode, so never pool it
+            pool_observation = false;
+            break;
+        }
+
+        if (options.max_pool_frames && i == options.action_repeat - 2) {
+            render_to_buf(pool_buf.data(), RES_W, RES_H, false);
+            pool_observation = true;
+        }
+    }
+
+    step_data.reward = reward;
+    step_data.level_complete = level_complete;
+    render_human_step++;
+
+    if (options.frame_stack > 1) {
+        if (step_data.done) {
+            // frames from the previous episode are not part of the new episode's history
+            std::fill(frame_stack_buf.begin(), frame_stack_buf.end(), 0);
+        } else {
+            frame_stack_pos = (frame_stack_pos + 1) % options.frame_stack;
+        }
+    }
+
+    observe();
+}
+
+void Game::step_frame() {
     cur_time += 1;
     bool will_force_reset = false;
 
@@ -150,13 +288,44 @@ void Game::step() {
     }
 
     episode_done = step_data.done;
-
-    observe();
 }
 
 void Game::observe() {
     render_to_buf(render_buf, RES_W, RES_H, false);
-    bgr32_to_rgb888(obs_bufs[0], render_buf, RES_W, RES_H);
+    if (pool_observation) {
+        max_rgb32(render_buf, pool_buf.data(), RES_W, RES_H);
+        pool_observation = false;
+    }
+    // with frame_stack, convert into the ring buffer, overwriting the newest slot rather than
+    // advancing so that observing twice is harmless
+    uint8_t *frame = nullptr;
+    if (options.frame_stack > 1) {
+        frame = &frame_stack_buf[frame_stack_pos * (frame_stack_buf.size() / options.frame_stack)];
+    }
+    auto obs_dst = [&](const std::string &name) -> void * {
+        auto it = obs_name_to_offset.find(name);
+        if (it == obs_name_to_offset.end()) {
+            return nullptr;
+        }
+        return frame == nullptr ? obs_bufs[it->second] : frame + obs_frame_offsets[it->second];
+    };
+    bgr32_to_observations(obs_dst("rgb"), obs_dst("gray"), obs_dst("rgb_32"), render_buf, RES_W, RES_H);
+
+    if (options.frame_stack > 1) {
+        // the observations are ordered from oldest to newest
+        const size_t frame_size = frame_stack_buf.size() / options.frame_stack;
+        for (size_t k = 0; k < obs_bufs.size(); k++) {
+            uint8_t *dst = (uint8_t *)(obs_bufs[k]);
+            for (int i = 1; i <= options.frame_stack; i++) {
+                int slot = (frame_stack_pos + i) % options.frame_stack;
+                memcpy(dst, &frame_stack_buf[slot * frame_size + obs_frame_offsets[k]], obs_frame_sizes[k]);
+                dst += obs_frame_sizes[k];
+            }
+        }
+    }
+    if (render_human && render_human_step % render_human_interval == 0) {
+        render_human_frame();
+    }
     *reward_ptr = step_data.reward;
     *first_ptr = (uint8_t)step_data.done;
     *(int32_t *)(info_bufs[info_name_to_offset.at("prev_level_seed")]) = (int32_t)(prev_level_seed);
@@ -164,11 +333,19 @@ void Game::observe() {
     *(int32_t *)(info_bufs[info_name_to_offset.at("level_seed")]) = (int32_t)(current_level_seed);
 }
 
+void Game::render_human_frame() {
+    // this runs on the stepping threads, so share one buffer per thread rather than one per game
+    static thread_local std::vector<uint32_t> render_hires_buf(RENDER_RES * RENDER_RES);
+    render_to_buf(render_hires_buf.data(), RENDER_RES, RENDER_RES, true);
+    bgr32_to_rgb888(info_bufs[info_name_to_offset.at("rgb")], render_hires_buf.data(), RENDER_RES, RENDER_RES);
+}
+
 void Game::game_init() {
 }
 
 void Game::serialize(WriteBuffer *b) {
-    b->write_int(SERIALIZE_VERSION);
+    bool has_frame_stack = options.frame_stack > 1;
+    b->write_int(has_frame_stack ? SERIALIZE_VERSION_FRAME_STACK : SERIALIZE_VERSION);
     
     b->write_string(game_name);
 
@@ -216,6 +393,13 @@ void Game::serialize(WriteBuffer *b) {
     // don't save render buf as we will just re-write it on next observation
     // uint32_t render_buf[RES_W * RES_H];
 
+    // older stacked frames can't be re-rendered, so save the whole stack
+    if (has_frame_stack) {
+        b->write_int(options.frame_stack);
+        b->write_int(frame_stack_pos);
+        b->write_vector_uint8(frame_stack_buf);
+    }
+
     b->write_int(cur_time);
     b->write_int(is_waiting_for_step);
 
@@ -229,7 +413,8 @@ void Game::serialize(WriteBuffer *b) {
 }
 
 void Game::deserialize(ReadBuffer *b) {
-    fassert(SERIALIZE_VERSION == b->read_int());
+    int version = b->read_int();
+    fassert(version == SERIALIZE_VERSION || version == SERIALIZE_VERSION_FRAME_STACK);
     fassert(game_name == b->read_string());
 
     options.paint_vel_info = b->read_int();
@@ -273,6 +458,18 @@ void Game::deserialize(ReadBuffer *b) {
 
     fixed_asset_seed = b->read_int();
 
+    if (version == SERIALIZE_VERSION_FRAME_STACK) {
+        fassert(options.frame_stack == b->read_int());
+        frame_stack_pos = b->read_int();
+        auto frames = b->read_vector_uint8();
+        fassert(frames.size() == frame_stack_buf.size());
+        frame_stack_buf = frames;
+    } else {
+        // a state without stacked frames, the older frames of a stack start out empty like after a reset
+        frame_stack_pos = 0;
+        std::fill(frame_stack_buf.begin(), frame_stack_buf.end(), 0);
+    }
+
     cur_time = b->read_int();
     is_waiting_for_step = b->read_int();
 }
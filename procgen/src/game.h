@@ -17,6 +17,8 @@ Base class used for all games, all games must inherit from this
 #include "object-ids.h"
 #include "game-registry.h"
 #include "buffer.h"
+#include "rasterizer.h"
+#include "pixel-convert.h"
 
 // We want all games to have same observation space. So all these
 // constants here related to observation space are constants forever.
@@ -25,8 +27,6 @@ const int RES_H = 64;
 
 const int RENDER_RES = 512;
 
-void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h);
-
 class VecOptions;
 
 enum DistributionMode {
@@ -52,6 +52,18 @@ struct GameOptions {
     int debug_mode = 0;
     DistributionMode distribution_mode = HardMode;
     bool use_sequential_levels = false;
+    RenderBackend renderer = QtRenderer;
+    int action_repeat = 1;
+    bool max_pool_frames = false;
+    int frame_stack = 1;
+    bool cache_scaled_assets = true;
+    bool cache_static_layer = true;
+    // collision checks scan every entity when there are fewer entities than this, since the entity grid
+    // costs more to build than it saves
+    int entity_grid_min_entities = 32;
+    // with fewer entities than this, and too few for the entity grid, stepping entities scans every entity
+    // instead of using sweep and prune
+    int sweep_min_entities = 8;
 
     // coinrun_old
     bool use_easy_jump = false;
@@ -59,10 +71,27 @@ struct GameOptions {
     int physics_mode = 0;
 };
 
+// a QPainter kept active on a destination buffer across frames, so that per frame rendering
+// doesn't pay for painter and paint engine setup
+struct RenderContext {
+    void *buf = nullptr;
+    int w = 0;
+    int h = 0;
+    bool antialias = false;
+    int last_used = 0;
+    std::unique_ptr<QImage> img;
+    // declared after img so that it is destroyed, and stops painting, first
+    std::unique_ptr<QPainter> painter;
+};
+
+// one for the observation and one for the max_pool_frames buffer
+const int NUM_RENDER_CONTEXTS = 2;
+
 class Game {
   public:
     const std::string game_name;
     std::map<std::string, int> info_name_to_offset;
+    std::map<std::string, int> obs_name_to_offset;
 
     GameOptions options;
 
@@ -93,6 +122,24 @@ class Game {
     int fixed_asset_seed = 0;
 
     uint32_t render_buf[RES_W * RES_H];
+    // second to last frame of a repeated action, only used with max_pool_frames
+    std::vector<uint32_t> pool_buf;
+    bool pool_observation = false;
+    // byte offset and size of each observation tensor within one frame
+    std::vector<size_t> obs_frame_offsets;
+    std::vector<size_t> obs_frame_sizes;
+    // the last options.frame_stack frames of all observation tensors, frame_stack_pos is the slot of the newest one
+    std::vector<uint8_t> frame_stack_buf;
+    int frame_stack_pos = 0;
+    Rasterizer rasterizer;
+    RenderContext render_contexts[NUM_RENDER_CONTEXTS];
+    int render_context_uses = 0;
+    // set by VecGame for the environments that also produce a RENDER_RES "rgb" info frame,
+    // rendered every render_human_interval steps
+    bool render_human = false;
+    int render_human_interval = 1;
+    int render_human_step = 0;
+    bool render_antialiased = false;
 
     int cur_time = 0;
 
@@ -107,9 +154,14 @@ class Game {
 
     Game(std::string name);
     void step();
+    void step_frame();
     void reset();
     void render_to_buf(void *buf, int w, int h, bool antialias);
     void parse_options(std::string name, VecOptions opt_vec);
+    void set_observation_spaces(const std::vector<std::string> &names, int frame_stack);
+    void render_human_frame();
+    QPainter &get_render_painter(void *dst, int w, int h, bool antialias);
+    void set_render_hints(QPainter &p, bool antialias);
 
     virtual ~Game() = 0;
     virtual void observe();
@@ -27,6 +27,7 @@ class CaveFlyerGame : public BasicAbstractGame {
         : BasicAbstractGame(NAME) {
         mixrate = 0.9f;
         room_manager = std::make_unique<RoomGenerator>(this);
+        use_static_layer = true;
     }
 
     void load_background_images() override {
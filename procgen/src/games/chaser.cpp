@@ -45,6 +45,7 @@ class ChaserGame : public BasicAbstractGame {
 
         maze_gen = nullptr;
         has_useful_vel_info = false;
+        use_static_layer = true;
     }
 
     void load_background_images() override {
@@ -110,7 +111,7 @@ class ChaserGame : public BasicAbstractGame {
 
     void draw_grid_obj(QPainter &p, const QRectF &rect, int type, int theme) override {
         if (type == ORB) {
-            p.fillRect(QRectF(rect.x() + rect.width() * (1 - ORB_DIM) / 2, rect.y() + rect.height() * (1 - ORB_DIM) / 2, rect.width() * ORB_DIM, rect.height() * ORB_DIM), QColor(0, 255, 0));
+            fill_rect(p, QRectF(rect.x() + rect.width() * (1 - ORB_DIM) / 2, rect.y() + rect.height() * (1 - ORB_DIM) / 2, rect.width() * ORB_DIM, rect.height() * ORB_DIM), QColor(0, 255, 0));
         } else {
             BasicAbstractGame::draw_grid_obj(p, rect, type, theme);
         }
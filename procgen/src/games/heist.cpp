@@ -31,6 +31,7 @@ class HeistGame : public BasicAbstractGame {
 
         out_of_bounds_object = WALL_OBJ;
         visibility = 8.0;
+        use_static_layer = true;
     }
 
     void load_background_images() override {
@@ -41,6 +41,7 @@ class Jumper : public BasicAbstractGame {
     Jumper()
         : BasicAbstractGame(NAME) {
         room_manager = std::make_unique<RoomGenerator>(this);
+        use_static_layer = true;
     }
 
     void load_background_images() override {
@@ -138,19 +139,17 @@ class Jumper : public BasicAbstractGame {
         QRectF compass_rect = get_abs_rect(view_dim - compass_dim - .25, .25, compass_dim, compass_dim);
         QColor clock_color = QColor(168, 166, 158);
 
-        set_pen_brush_color(p, clock_color);
-        p.drawEllipse(compass_rect);
+        draw_ellipse(p, compass_rect, clock_color, 1);
         QColor highlight_color = QColor(252, 186, 3);
 
         float pen_thickness = rect.width() / (256.0 / compass_dim);
 
-        set_pen_brush_color(p, highlight_color, pen_thickness);
         float cx = compass_rect.center().x();
         float cy = compass_rect.center().y();
         float cr = compass_rect.width() / 2 * .95;
         float theta = get_theta(agent, goal);
 
-        p.drawLine(cx, cy, cx + cr * cos(theta), cy - cr * sin(theta));
+        draw_line(p, cx, cy, cx + cr * cos(theta), cy - cr * sin(theta), highlight_color, pen_thickness);
 
         float dist = get_distance(agent, goal);
         float dist_pct = dist / (main_width * sqrt(2));
@@ -158,13 +157,11 @@ class Jumper : public BasicAbstractGame {
         float bar_thickness = compass_dim / 8;
 
         QRectF dist_rect = get_abs_rect(view_dim - compass_dim - .25, .25 + compass_dim, compass_dim * dist_pct, bar_thickness);
-        p.fillRect(dist_rect, highlight_color);
+        fill_rect(p, dist_rect, highlight_color);
 
         if (jump_delta < 0 && !has_support) {
             QRectF r1 = get_object_rect(agent);
-            p.setBrush(QColor(255, 255, 255, 120));
-            p.setPen(Qt::NoPen);
-            p.drawEllipse(QRect(r1.x(), r1.y() + r1.height() * (5.0 / 6), r1.width(), r1.height() / 3));
+            draw_ellipse(p, QRect(r1.x(), r1.y() + r1.height() * (5.0 / 6), r1.width(), r1.height() / 3), QColor(255, 255, 255, 120));
         }
     }
 
@@ -21,6 +21,7 @@ class MazeGame : public BasicAbstractGame {
 
         out_of_bounds_object = WALL_OBJ;
         visibility = 8.0;
+        use_static_layer = true;
     }
 
     void load_background_images() override {
@@ -33,6 +33,7 @@ class MinerGame : public BasicAbstractGame {
 
         out_of_bounds_object = OOB_WALL;
         visibility = 8.0;
+        use_static_layer = true;
     }
 
     void load_background_images() override {
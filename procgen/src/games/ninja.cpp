@@ -171,7 +171,7 @@ class Ninja : public BasicAbstractGame {
         float bar_height = 3 * jump_charge;
 
         QRectF dist_rect2 = get_abs_rect(.25, visibility - .5 - bar_height, .5, bar_height);
-        p.fillRect(dist_rect2, charge_color);
+        fill_rect(p, dist_rect2, charge_color);
     }
 
     void fill_block_top(int x, int y, int dx, int dy, char fill, char top) {
@@ -70,10 +70,10 @@ class PlunderGame : public BasicAbstractGame {
         QColor progress_color = QColor(245, 66, 144);
 
         QRectF dist_rect1 = get_abs_rect(.25, .25, main_width * juice_left, .5);
-        p.fillRect(dist_rect1, juice_color);
+        fill_rect(p, dist_rect1, juice_color);
 
         QRectF dist_rect2 = get_abs_rect(.25, .75, main_width * (targets_hit * 1.0 / target_quota), .5);
-        p.fillRect(dist_rect2, progress_color);
+        fill_rect(p, dist_rect2, progress_color);
     }
 
     bool is_target(int theme_num) {
@@ -202,7 +202,7 @@ class PlunderGame : public BasicAbstractGame {
             float ent_y = (lane * .11 + .4) * (main_height / 2 - ent_r) + main_height / 2;
             float moves_right = lane_directions[lane];
             float ent_vx = lane_vels[lane] * (moves_right ? 1 : -1);
-            auto ent = std::make_shared<Entity>(0, ent_y, ent_vx, 0, ent_r, SHIP);
+            auto ent = make_entity(0, ent_y, ent_vx, 0, ent_r, SHIP);
             ent->image_type = SHIP;
             ent->image_theme = image_permutation[rand_gen.randn(num_current_ship_types)];
             match_aspect_ratio(ent);
@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+
+Bounded lock-free multi-producer multi-consumer queue of integer indices
+
+This is the array based queue by Dmitry Vyukov, each cell carries a sequence number that tells
+producers and consumers whether it is free to write or ready to read, so neither side ever takes a lock.
+
+*/
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+class IndexQueue {
+  public:
+    // capacity is rounded up to a power of two
+    IndexQueue(size_t capacity);
+
+    // returns false if the queue is full
+    bool push(int value);
+    // returns false if the queue is empty
+    bool pop(int *value);
+    // may be stale by the time it returns, only use it as a hint
+    bool empty() const;
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        int value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // keep the producer and consumer positions on separate cache lines
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+};
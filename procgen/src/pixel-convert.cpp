@@ -0,0 +1,198 @@
+#include "pixel-convert.h"
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+// all kernels treat the image as one contiguous run of pixels since neither buffer has row padding
+static void convert_scalar(uint8_t *dst, const uint8_t *src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        src += 4;
+        dst += 3;
+    }
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+__attribute__((target("ssse3"))) static void convert_ssse3(uint8_t *dst, const uint8_t *src, int n) {
+    // pack 4 pixels into the low 12 bytes, swapping red and blue
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 0)), shuffle);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 16)), shuffle);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 32)), shuffle);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 48)), shuffle);
+
+        _mm_storeu_si128((__m128i *)(dst + 0), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+
+        src += 64;
+        dst += 48;
+    }
+
+    convert_scalar(dst, src, n - i);
+}
+
+__attribute__((target("avx2"))) static void convert_avx2(uint8_t *dst, const uint8_t *src, int n) {
+    // pshufb works within 128 bit lanes, so pack each lane to 12 bytes and then move the lanes together
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+    // each iteration stores 32 bytes but only advances 24, so stop while there are at least
+    // 3 pixels left for the scalar loop to write
+    int i = 0;
+    for (; i + 8 + 3 <= n; i += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)src), shuffle);
+        v = _mm256_permutevar8x32_epi32(v, compact);
+        _mm256_storeu_si256((__m256i *)dst, v);
+
+        src += 32;
+        dst += 24;
+    }
+
+    convert_scalar(dst, src, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi"))) static void convert_avx512vbmi(uint8_t *dst, const uint8_t *src, int n) {
+    // vpermb can permute bytes across the whole register, so 16 pixels become 48 bytes in one step
+    alignas(64) uint8_t indices[64] = {0};
+    for (int j = 0; j < 48; j++) {
+        indices[j] = (uint8_t)((j / 3) * 4 + (2 - j % 3));
+    }
+    const __m512i permute = _mm512_load_si512((const void *)indices);
+    const __mmask64 store_mask = (1ULL << 48) - 1;
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i v = _mm512_maskz_permutexvar_epi8(~0ULL, permute, _mm512_loadu_si512((const void *)src));
+        _mm512_mask_storeu_epi8(dst, store_mask, v);
+
+        src += 64;
+        dst += 48;
+    }
+
+    convert_scalar(dst, src, n - i);
+}
+
+static SimdLevel detect_simd_level_uncached() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw")) {
+        return SimdAVX512VBMI;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdAVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return SimdSSSE3;
+    }
+    return SimdNone;
+}
+
+#endif
+
+SimdLevel detect_simd_level() {
+#ifdef PIXEL_CONVERT_X86
+    static const SimdLevel level = detect_simd_level_uncached();
+    return level;
+#else
+    return SimdNone;
+#endif
+}
+
+SimdLevel bgr32_to_rgb888_with_level(SimdLevel level, void *dst_rgb888, void *src_bgr32, int w, int h) {
+    uint8_t *dst = (uint8_t *)dst_rgb888;
+    const uint8_t *src = (const uint8_t *)src_bgr32;
+    int n = w * h;
+
+    SimdLevel supported = detect_simd_level();
+    if (level > supported) {
+        level = supported;
+    }
+
+    switch (level) {
+#ifdef PIXEL_CONVERT_X86
+    case SimdAVX512VBMI:
+        convert_avx512vbmi(dst, src, n);
+        break;
+    case SimdAVX2:
+        convert_avx2(dst, src, n);
+        break;
+    case SimdSSSE3:
+        convert_ssse3(dst, src, n);
+        break;
+#endif
+    default:
+        level = SimdNone;
+        convert_scalar(dst, src, n);
+        break;
+    }
+
+    return level;
+}
+
+void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h) {
+    bgr32_to_rgb888_with_level(detect_simd_level(), dst_rgb888, src_bgr32, w, h);
+}
+
+void bgr32_to_observations(void *dst_rgb888, void *dst_gray, void *dst_rgb888_half, void *src_bgr32, int w, int h) {
+    if (dst_gray == nullptr && dst_rgb888_half == nullptr) {
+        bgr32_to_rgb888(dst_rgb888, src_bgr32, w, h);
+        return;
+    }
+
+    SimdLevel level = detect_simd_level();
+    const uint8_t *src = (const uint8_t *)src_bgr32;
+    uint8_t *rgb = (uint8_t *)dst_rgb888;
+    uint8_t *gray = (uint8_t *)dst_gray;
+    uint8_t *half = (uint8_t *)dst_rgb888_half;
+
+    // work on pairs of rows so each source row is only brought into cache once
+    for (int y = 0; y < h; y += 2) {
+        const uint8_t *row0 = src + y * w * 4;
+        const uint8_t *row1 = row0 + w * 4;
+
+        if (rgb != nullptr) {
+            bgr32_to_rgb888_with_level(level, rgb + y * w * 3, (void *)row0, w, 2);
+        }
+
+        if (gray != nullptr) {
+            // ITU-R BT.601 luma in 8 bit fixed point
+            uint8_t *g = gray + y * w;
+            for (int i = 0; i < 2 * w; i++) {
+                const uint8_t *px = row0 + i * 4;
+                g[i] = (uint8_t)((29 * px[0] + 150 * px[1] + 77 * px[2] + 128) >> 8);
+            }
+        }
+
+        if (half != nullptr) {
+            uint8_t *d = half + (y / 2) * (w / 2) * 3;
+            for (int x = 0; x < w / 2; x++) {
+                const uint8_t *a = row0 + x * 8;
+                const uint8_t *b = row1 + x * 8;
+                for (int c = 0; c < 3; c++) {
+                    d[x * 3 + c] = (uint8_t)((a[2 - c] + a[6 - c] + b[2 - c] + b[6 - c] + 2) >> 2);
+                }
+            }
+        }
+    }
+}
+
+void max_rgb32(void *dst_rgb32, const void *src_rgb32, int w, int h) {
+    uint8_t *dst = (uint8_t *)dst_rgb32;
+    const uint8_t *src = (const uint8_t *)src_rgb32;
+    int n = w * h * 4;
+
+    // simple enough for the compiler to vectorize
+    for (int i = 0; i < n; i++) {
+        dst[i] = dst[i] > src[i] ? dst[i] : src[i];
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+
+Conversion from the RGB32 buffers that we render into to the RGB888 observations we return
+
+On x86 the fastest kernel supported by the current CPU is selected at runtime, since the packaged
+library is compiled for a minimum spec processor and can't assume newer instruction sets.
+
+*/
+
+enum SimdLevel {
+    SimdNone = 0,
+    SimdSSSE3 = 1,
+    SimdAVX2 = 2,
+    SimdAVX512VBMI = 3,
+};
+
+// the best level supported by this CPU
+SimdLevel detect_simd_level();
+
+void bgr32_to_rgb888(void *dst_rgb888, void *src_bgr32, int w, int h);
+
+// convert to any combination of full resolution RGB888, 8 bit grayscale and RGB888 box filtered
+// to half resolution in a single pass over the image, null outputs are skipped, w and h must be even
+void bgr32_to_observations(void *dst_rgb888, void *dst_gray, void *dst_rgb888_half, void *src_bgr32, int w, int h);
+
+// per channel maximum of two RGB32 images, stored in dst
+void max_rgb32(void *dst_rgb32, const void *src_rgb32, int w, int h);
+
+// use a specific kernel, levels above detect_simd_level() are lowered, returns the level that was used
+SimdLevel bgr32_to_rgb888_with_level(SimdLevel level, void *dst_rgb888, void *src_bgr32, int w, int h);
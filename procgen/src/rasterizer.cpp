@@ -0,0 +1,361 @@
+#include "rasterizer.h"
+#include <math.h>
+#include <string.h>
+
+// number of subsamples per axis used to compute coverage for antialiased shapes
+const int SUBSAMPLES = 4;
+
+// same rounding rule as qRound, which Qt uses to decide pixel coverage for aliased drawing
+static inline int round_px(float f) {
+    return (int)floor(f + 0.5f);
+}
+
+static inline int clamp_int(int v, int low, int high) {
+    return v < low ? low : (v > high ? high : v);
+}
+
+// multiply all 4 channels of x by a / 255, this is the BYTE_MUL formula from Qt's raster engine
+static inline uint32_t byte_mul(uint32_t x, uint32_t a) {
+    uint32_t t = (x & 0xff00ff) * a;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+
+    x = ((x >> 8) & 0xff00ff) * a;
+    x = (x + ((x >> 8) & 0xff00ff) + 0x800080);
+    x &= 0xff00ff00;
+
+    return x | t;
+}
+
+// interpolate between two premultiplied pixels, w is in [0, 256]
+static inline uint32_t interpolate_256(uint32_t a, uint32_t b, uint32_t w) {
+    uint32_t iw = 256 - w;
+    uint32_t t = (((a & 0xff00ff) * iw + (b & 0xff00ff) * w) >> 8) & 0xff00ff;
+    uint32_t u = ((((a >> 8) & 0xff00ff) * iw + ((b >> 8) & 0xff00ff) * w)) & 0xff00ff00;
+    return t | u;
+}
+
+static inline uint32_t premultiply(uint32_t argb) {
+    uint32_t a = argb >> 24;
+    if (a == 255)
+        return argb;
+    if (a == 0)
+        return 0;
+    return (byte_mul(argb, a) & 0x00ffffff) | (a << 24);
+}
+
+static inline uint32_t fetch_pixel(const uchar *row, int x, QImage::Format format) {
+    uint32_t px = ((const uint32_t *)row)[x];
+    if (format == QImage::Format_ARGB32_Premultiplied) {
+        return px;
+    } else if (format == QImage::Format_ARGB32) {
+        return premultiply(px);
+    }
+    return px | 0xff000000;
+}
+
+// source over composition of a premultiplied pixel onto an opaque destination
+static inline uint32_t blend_over(uint32_t dst, uint32_t src) {
+    uint32_t a = src >> 24;
+    if (a == 255)
+        return src;
+    if (a == 0)
+        return dst;
+    return (src + byte_mul(dst, 255 - a)) | 0xff000000;
+}
+
+void Rasterizer::begin(uint32_t *_pixels, int w, int h, bool _smooth) {
+    pixels = _pixels;
+    width = w;
+    height = h;
+    smooth = _smooth;
+    opacity = 255;
+    clip_left = 0;
+    clip_top = 0;
+    clip_right = w;
+    clip_bottom = h;
+}
+
+void Rasterizer::set_clip(const QRect &rect) {
+    clip_left = clamp_int(rect.x(), 0, width);
+    clip_top = clamp_int(rect.y(), 0, height);
+    clip_right = clamp_int(rect.x() + rect.width(), clip_left, width);
+    clip_bottom = clamp_int(rect.y() + rect.height(), clip_top, height);
+}
+
+void Rasterizer::blit(int x, int y, const QImage &image) {
+    int x0 = clamp_int(x, clip_left, clip_right);
+    int x1 = clamp_int(x + image.width(), clip_left, clip_right);
+    int y0 = clamp_int(y, clip_top, clip_bottom);
+    int y1 = clamp_int(y + image.height(), clip_top, clip_bottom);
+
+    if (x1 <= x0)
+        return;
+
+    for (int row = y0; row < y1; row++) {
+        const uint32_t *src = (const uint32_t *)image.constScanLine(row - y) + (x0 - x);
+        memcpy(pixels + row * width + x0, src, (x1 - x0) * sizeof(uint32_t));
+    }
+}
+
+void Rasterizer::set_opacity(float _opacity) {
+    opacity = clamp_int(round_px(_opacity * 255), 0, 255);
+}
+
+void Rasterizer::blend_span(uint32_t *dst, int count, uint32_t premul, int coverage) {
+    int alpha = coverage * opacity / 255;
+    uint32_t src = alpha == 255 ? premul : byte_mul(premul, alpha);
+
+    if ((src >> 24) == 255) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = src;
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            dst[i] = blend_over(dst[i], src);
+        }
+    }
+}
+
+void Rasterizer::fill_rect(const QRectF &rect, const QColor &color) {
+    uint32_t premul = premultiply(color.rgba());
+
+    if (!smooth) {
+        int x0 = clamp_int(round_px(rect.x()), clip_left, clip_right);
+        int x1 = clamp_int(round_px(rect.x() + rect.width()), clip_left, clip_right);
+        int y0 = clamp_int(round_px(rect.y()), clip_top, clip_bottom);
+        int y1 = clamp_int(round_px(rect.y() + rect.height()), clip_top, clip_bottom);
+
+        for (int y = y0; y < y1; y++) {
+            blend_span(pixels + y * width + x0, x1 - x0, premul, 255);
+        }
+
+        return;
+    }
+
+    // antialiased, weight the edge pixels by the fraction of the pixel covered
+    float left = rect.x();
+    float right = rect.x() + rect.width();
+    float top = rect.y();
+    float bottom = rect.y() + rect.height();
+
+    int x0 = clamp_int((int)floor(left), clip_left, clip_right);
+    int x1 = clamp_int((int)ceil(right), clip_left, clip_right);
+    int y0 = clamp_int((int)floor(top), clip_top, clip_bottom);
+    int y1 = clamp_int((int)ceil(bottom), clip_top, clip_bottom);
+
+    for (int y = y0; y < y1; y++) {
+        float cov_y = fminf(y + 1, bottom) - fmaxf(y, top);
+        for (int x = x0; x < x1; x++) {
+            float cov_x = fminf(x + 1, right) - fmaxf(x, left);
+            int coverage = round_px(cov_x * cov_y * 255);
+            if (coverage > 0) {
+                blend_span(pixels + y * width + x, 1, premul, coverage);
+            }
+        }
+    }
+}
+
+template <typename F>
+void Rasterizer::fill_shape(float left, float top, float right, float bottom, const QColor &color, F inside) {
+    uint32_t premul = premultiply(color.rgba());
+
+    int x0 = clamp_int((int)floor(left), clip_left, clip_right);
+    int x1 = clamp_int((int)ceil(right), clip_left, clip_right);
+    int y0 = clamp_int((int)floor(top), clip_top, clip_bottom);
+    int y1 = clamp_int((int)ceil(bottom), clip_top, clip_bottom);
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            int coverage = 0;
+
+            if (smooth) {
+                int count = 0;
+                for (int sy = 0; sy < SUBSAMPLES; sy++) {
+                    for (int sx = 0; sx < SUBSAMPLES; sx++) {
+                        count += inside(x + (sx + 0.5f) / SUBSAMPLES, y + (sy + 0.5f) / SUBSAMPLES);
+                    }
+                }
+                coverage = count * 255 / (SUBSAMPLES * SUBSAMPLES);
+            } else {
+                coverage = inside(x + 0.5f, y + 0.5f) ? 255 : 0;
+            }
+
+            if (coverage > 0) {
+                blend_span(pixels + y * width + x, 1, premul, coverage);
+            }
+        }
+    }
+}
+
+void Rasterizer::fill_ellipse(const QRectF &rect, const QColor &color, float pen_width) {
+    // an outline drawn with the same color extends the ellipse by half the pen width
+    float rx = rect.width() / 2 + pen_width / 2;
+    float ry = rect.height() / 2 + pen_width / 2;
+    float cx = rect.x() + rect.width() / 2;
+    float cy = rect.y() + rect.height() / 2;
+
+    if (rx <= 0 || ry <= 0)
+        return;
+
+    fill_shape(cx - rx, cy - ry, cx + rx, cy + ry, color, [=](float px, float py) {
+        float dx = (px - cx) / rx;
+        float dy = (py - cy) / ry;
+        return dx * dx + dy * dy <= 1;
+    });
+}
+
+void Rasterizer::draw_line(float x1, float y1, float x2, float y2, const QColor &color, float pen_width) {
+    float half_w = fmaxf(pen_width, 1) / 2;
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float len = sqrtf(dx * dx + dy * dy);
+
+    // direction along the line, degenerate lines become a square
+    float ux = len > 0 ? dx / len : 1;
+    float uy = len > 0 ? dy / len : 0;
+
+    // square caps extend the line by half the pen width on both ends
+    float left = fminf(x1, x2) - 2 * half_w;
+    float right = fmaxf(x1, x2) + 2 * half_w;
+    float top = fminf(y1, y2) - 2 * half_w;
+    float bottom = fmaxf(y1, y2) + 2 * half_w;
+
+    fill_shape(left, top, right, bottom, color, [=](float px, float py) {
+        float rel_x = px - x1;
+        float rel_y = py - y1;
+        float t = rel_x * ux + rel_y * uy;
+        float s = rel_y * ux - rel_x * uy;
+        return t >= -half_w && t <= len + half_w && fabsf(s) <= half_w;
+    });
+}
+
+void Rasterizer::draw_image(const QRectF &rect, const QImage &image, float rotation) {
+    if (image.width() == 0 || image.height() == 0 || rect.width() <= 0 || rect.height() <= 0 || opacity == 0) {
+        return;
+    }
+
+    if (rotation == 0 && !smooth) {
+        draw_image_nearest(rect, image);
+    } else {
+        draw_image_transformed(rect, image, rotation);
+    }
+}
+
+void Rasterizer::draw_image_nearest(const QRectF &rect, const QImage &image) {
+    int sw = image.width();
+    int sh = image.height();
+    QImage::Format format = image.format();
+
+    int x0 = clamp_int(round_px(rect.x()), clip_left, clip_right);
+    int x1 = clamp_int(round_px(rect.x() + rect.width()), clip_left, clip_right);
+    int y0 = clamp_int(round_px(rect.y()), clip_top, clip_bottom);
+    int y1 = clamp_int(round_px(rect.y() + rect.height()), clip_top, clip_bottom);
+
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    float scale_x = sw / rect.width();
+    float scale_y = sh / rect.height();
+
+    // sample at pixel centers, the source column for each destination column is the same for every row
+    col_lookup.resize(x1 - x0);
+    for (int x = x0; x < x1; x++) {
+        col_lookup[x - x0] = clamp_int((int)((x + 0.5f - rect.x()) * scale_x), 0, sw - 1);
+    }
+
+    for (int y = y0; y < y1; y++) {
+        int sy = clamp_int((int)((y + 0.5f - rect.y()) * scale_y), 0, sh - 1);
+        const uchar *src_row = image.constScanLine(sy);
+        uint32_t *dst = pixels + y * width;
+
+        if (format == QImage::Format_RGB32 && opacity == 255) {
+            for (int x = x0; x < x1; x++) {
+                dst[x] = ((const uint32_t *)src_row)[col_lookup[x - x0]] | 0xff000000;
+            }
+        } else {
+            for (int x = x0; x < x1; x++) {
+                uint32_t src = fetch_pixel(src_row, col_lookup[x - x0], format);
+                if (opacity != 255) {
+                    src = byte_mul(src, opacity);
+                }
+                dst[x] = blend_over(dst[x], src);
+            }
+        }
+    }
+}
+
+void Rasterizer::draw_image_transformed(const QRectF &rect, const QImage &image, float rotation) {
+    float w = rect.width();
+    float h = rect.height();
+    float cx = rect.x() + w / 2;
+    float cy = rect.y() + h / 2;
+    float c = cosf(rotation);
+    float s = sinf(rotation);
+
+    // bounding box of the rotated rect
+    float ex = fabsf(w / 2 * c) + fabsf(h / 2 * s);
+    float ey = fabsf(w / 2 * s) + fabsf(h / 2 * c);
+
+    int x0 = clamp_int((int)floor(cx - ex), clip_left, clip_right);
+    int x1 = clamp_int((int)ceil(cx + ex), clip_left, clip_right);
+    int y0 = clamp_int((int)floor(cy - ey), clip_top, clip_bottom);
+    int y1 = clamp_int((int)ceil(cy + ey), clip_top, clip_bottom);
+
+    float scale_x = image.width() / w;
+    float scale_y = image.height() / h;
+
+    for (int y = y0; y < y1; y++) {
+        uint32_t *dst = pixels + y * width;
+        float dy = y + 0.5f - cy;
+
+        for (int x = x0; x < x1; x++) {
+            float dx = x + 0.5f - cx;
+
+            // map the pixel center back into the unrotated rect, matching QPainter::rotate()
+            float lx = dx * c + dy * s + w / 2;
+            float ly = -dx * s + dy * c + h / 2;
+
+            if (lx < 0 || lx >= w || ly < 0 || ly >= h)
+                continue;
+
+            float u = lx * scale_x;
+            float v = ly * scale_y;
+            uint32_t src = smooth ? sample_bilinear(image, u, v) : sample_nearest(image, u, v);
+
+            if (opacity != 255) {
+                src = byte_mul(src, opacity);
+            }
+
+            dst[x] = blend_over(dst[x], src);
+        }
+    }
+}
+
+uint32_t Rasterizer::sample_nearest(const QImage &image, float u, float v) {
+    int sx = clamp_int((int)u, 0, image.width() - 1);
+    int sy = clamp_int((int)v, 0, image.height() - 1);
+    return fetch_pixel(image.constScanLine(sy), sx, image.format());
+}
+
+uint32_t Rasterizer::sample_bilinear(const QImage &image, float u, float v) {
+    float fu = u - 0.5f;
+    float fv = v - 0.5f;
+    int ix = (int)floor(fu);
+    int iy = (int)floor(fv);
+    uint32_t wx = (uint32_t)((fu - ix) * 256);
+    uint32_t wy = (uint32_t)((fv - iy) * 256);
+
+    int max_x = image.width() - 1;
+    int max_y = image.height() - 1;
+    int x0 = clamp_int(ix, 0, max_x);
+    int x1 = clamp_int(ix + 1, 0, max_x);
+    const uchar *row0 = image.constScanLine(clamp_int(iy, 0, max_y));
+    const uchar *row1 = image.constScanLine(clamp_int(iy + 1, 0, max_y));
+    QImage::Format format = image.format();
+
+    uint32_t top = interpolate_256(fetch_pixel(row0, x0, format), fetch_pixel(row0, x1, format), wx);
+    uint32_t bottom = interpolate_256(fetch_pixel(row1, x0, format), fetch_pixel(row1, x1, format), wx);
+
+    return interpolate_256(top, bottom, wy);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+
+Minimal software rasterizer that draws directly into an RGB32 buffer
+
+This is an alternative to QPainter for the small set of drawing operations used by the games:
+axis-aligned or rotated image blits with nearest/bilinear sampling, solid rectangles, ellipses and lines.
+Qt remains the reference implementation, output from this class should be close but is not pixel identical.
+
+*/
+
+#include <QColor>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <vector>
+
+enum RenderBackend {
+    QtRenderer = 0,
+    NativeRenderer = 1,
+};
+
+class Rasterizer {
+  public:
+    // bind to an RGB32 buffer, smooth enables bilinear sampling and antialiased shapes
+    void begin(uint32_t *pixels, int w, int h, bool smooth);
+
+    void set_opacity(float opacity);
+    // restrict drawing to a rect, cleared by begin()
+    void set_clip(const QRect &rect);
+    // opaque copy of an RGB32 image with its top left corner at (x, y)
+    void blit(int x, int y, const QImage &image);
+    void fill_rect(const QRectF &rect, const QColor &color);
+    void fill_ellipse(const QRectF &rect, const QColor &color, float pen_width = 0);
+    void draw_line(float x1, float y1, float x2, float y2, const QColor &color, float pen_width);
+    void draw_image(const QRectF &rect, const QImage &image, float rotation = 0);
+
+  private:
+    uint32_t *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    bool smooth = false;
+    int opacity = 255;
+    int clip_left = 0;
+    int clip_top = 0;
+    int clip_right = 0;
+    int clip_bottom = 0;
+
+    std::vector<int> col_lookup;
+
+    void blend_span(uint32_t *dst, int count, uint32_t premul, int coverage);
+    template <typename F>
+    void fill_shape(float left, float top, float right, float bottom, const QColor &color, F inside);
+    void draw_image_nearest(const QRectF &rect, const QImage &image);
+    void draw_image_transformed(const QRectF &rect, const QImage &image, float rotation);
+    uint32_t sample_nearest(const QImage &image, float u, float v);
+    uint32_t sample_bilinear(const QImage &image, float u, float v);
+};
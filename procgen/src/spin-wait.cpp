@@ -0,0 +1,27 @@
+#include "spin-wait.h"
+#include <algorithm>
+
+void SpinWait::configure(int spin_wait_us) {
+    adaptive = spin_wait_us < 0;
+    max_budget_ns = (int64_t)(adaptive ? DEFAULT_MAX_SPIN_US : spin_wait_us) * 1000;
+    budget_ns = max_budget_ns;
+    avg_wait_ns = 0.0;
+}
+
+void SpinWait::record_wait(std::chrono::steady_clock::duration wait) {
+    if (!adaptive) {
+        return;
+    }
+
+    // cap long waits so that a single idle period doesn't disable spinning for a long time
+    double wait_ns = std::min((double)std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count(), 4.0 * max_budget_ns);
+    avg_wait_ns = 0.9 * avg_wait_ns + 0.1 * wait_ns;
+
+    if (avg_wait_ns > max_budget_ns) {
+        // work usually arrives too late for spinning to pay off
+        budget_ns = 0;
+    } else {
+        // leave some headroom over a typical wait
+        budget_ns = std::min((int64_t)(2.0 * avg_wait_ns) + 1000, max_budget_ns);
+    }
+}
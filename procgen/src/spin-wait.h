@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+
+Adaptive spin-then-block waiting
+
+Waking a sleeping thread through the kernel costs tens of microseconds, which is more than a step of a
+cheap game. A SpinWait busy waits for a while before a thread goes to sleep. The spin budget follows the
+waits it has seen recently: if work usually arrives within the maximum budget, it spins a bit longer
+than a typical wait; otherwise spinning would only burn CPU, so it doesn't spin at all.
+
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// the maximum spin budget when it's tuned automatically
+const int DEFAULT_MAX_SPIN_US = 100;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+class SpinWait {
+  public:
+    // spin_wait_us < 0 tunes the budget automatically up to DEFAULT_MAX_SPIN_US, 0 never spins
+    // and a positive value always spins for that long
+    void configure(int spin_wait_us);
+
+    // spin until done() returns true or the budget runs out, returns the last value of done()
+    template <typename F>
+    bool spin(F done) {
+        wait_start = std::chrono::steady_clock::now();
+        if (budget_ns <= 0) {
+            return done();
+        }
+
+        auto deadline = wait_start + std::chrono::nanoseconds(budget_ns);
+        while (1) {
+            // reading the clock costs more than a pause, so only check it every few iterations
+            for (int i = 0; i < 64; i++) {
+                if (done()) {
+                    record_wait(std::chrono::steady_clock::now() - wait_start);
+                    return true;
+                }
+                cpu_relax();
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+        }
+    }
+
+    // call after blocking when spin() returned false
+    void finish_blocking() {
+        record_wait(std::chrono::steady_clock::now() - wait_start);
+    }
+
+  private:
+    bool adaptive = false;
+    int64_t max_budget_ns = 0;
+    int64_t budget_ns = 0;
+    // exponential moving average of how long waits took
+    double avg_wait_ns = 0.0;
+    std::chrono::steady_clock::time_point wait_start;
+
+    void record_wait(std::chrono::steady_clock::duration wait);
+};
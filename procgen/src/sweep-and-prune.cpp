@@ -0,0 +1,94 @@
+#include "sweep-and-prune.h"
+#include <algorithm>
+#include <cmath>
+
+// extra room around each box for the small moves that pushes and reflections make
+const float SWEEP_SLACK = 0.5f;
+
+void SweepAndPrune::build(const std::vector<std::shared_ptr<Entity>> &entities) {
+    int count = (int)(entities.size());
+
+    boxes.resize(count);
+    overlaps.resize(count);
+    order.clear();
+    escaped.clear();
+
+    for (int i = 0; i < count; i++) {
+        const Entity &ent = *entities[i];
+        // entities can grow while stepping, see Entity::step()
+        float grow = std::max(ent.grow_rate, 1.0f);
+        float reach_x = ent.rx * grow + fabsf(ent.vx) + SWEEP_SLACK;
+        float reach_y = ent.ry * grow + fabsf(ent.vy) + SWEEP_SLACK;
+
+        Box &box = boxes[i];
+        box.x0 = ent.x - reach_x;
+        box.x1 = ent.x + reach_x;
+        box.y0 = ent.y - reach_y;
+        box.y1 = ent.y + reach_y;
+
+        overlaps[i].clear();
+
+        if (std::isfinite(box.x0) && std::isfinite(box.x1) && std::isfinite(box.y0) && std::isfinite(box.y1)) {
+            order.push_back(i);
+        } else {
+            escaped.push_back(i);
+        }
+    }
+
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return boxes[a].x0 < boxes[b].x0; });
+
+    for (size_t k = 0; k < order.size(); k++) {
+        int a = order[k];
+        const Box &box_a = boxes[a];
+
+        for (size_t l = k + 1; l < order.size(); l++) {
+            int b = order[l];
+            const Box &box_b = boxes[b];
+
+            if (box_b.x0 > box_a.x1) {
+                break;
+            }
+
+            if (box_b.y0 <= box_a.y1 && box_a.y0 <= box_b.y1) {
+                overlaps[a].push_back(b);
+                overlaps[b].push_back(a);
+            }
+        }
+    }
+
+    for (auto &pairs : overlaps) {
+        std::sort(pairs.begin(), pairs.end(), [](int a, int b) { return a > b; });
+    }
+}
+
+bool SweepAndPrune::contains(int idx, const Entity &ent) const {
+    const Box &box = boxes[idx];
+    return ent.x - ent.rx >= box.x0 && ent.x + ent.rx <= box.x1 && ent.y - ent.ry >= box.y0 && ent.y + ent.ry <= box.y1;
+}
+
+void SweepAndPrune::mark_escaped(int idx) {
+    escaped.push_back(idx);
+}
+
+void SweepAndPrune::candidates(int idx, int limit, std::vector<int> *out) const {
+    out->clear();
+
+    for (int other : overlaps[idx]) {
+        if (other < limit) {
+            out->push_back(other);
+        }
+    }
+
+    if (escaped.empty()) {
+        return;
+    }
+
+    for (int other : escaped) {
+        if (other < limit) {
+            out->push_back(other);
+        }
+    }
+
+    std::sort(out->begin(), out->end(), [](int a, int b) { return a > b; });
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+}
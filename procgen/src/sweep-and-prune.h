@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+
+Broadphase for the entity collisions checked while entities step
+
+Before the entities step, each one gets a box covering everywhere it can reach this step given its velocity.
+Sorting the boxes along x and sweeping over them finds every pair of boxes that overlap, so each sub step only
+has to look at the entities whose boxes overlap the box of the stepping entity.
+
+Entities can still end up outside of their box, pushes and reflections can move them further than their
+velocity. The caller checks with contains() and marks entities that left their box as escaped, from then on
+they are a candidate for every entity, and falls back to looking at every entity when the stepping entity
+itself left its box.
+
+*/
+
+#include <memory>
+#include <vector>
+#include "entity.h"
+
+class SweepAndPrune {
+  public:
+    // compute the boxes and overlapping pairs for the entities as they are before stepping
+    void build(const std::vector<std::shared_ptr<Entity>> &entities);
+
+    // whether ent is still within the box of entity idx
+    bool contains(int idx, const Entity &ent) const;
+    void mark_escaped(int idx);
+
+    // fill out with the indices below limit of the entities that may collide with entity idx, in decreasing order
+    void candidates(int idx, int limit, std::vector<int> *out) const;
+
+  private:
+    struct Box {
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+    };
+
+    std::vector<Box> boxes;
+    // indices sorted by the left edge of their box
+    std::vector<int> order;
+    // for each entity, the entities whose boxes overlap its own in decreasing order
+    std::vector<std::vector<int>> overlaps;
+    // entities that left their box or never had a valid one, they are a candidate for every entity
+    std::vector<int> escaped;
+};
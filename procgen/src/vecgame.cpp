@@ -2,8 +2,20 @@
 #include "cpp-utils.h"
 #include "vecoptions.h"
 #include "game.h"
+#include "cpu-affinity.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
 const int32_t END_OF_BUFFER = 0xCAFECAFE;
+// weight of the newest sample in the moving averages of step costs
+const double COST_EMA_ALPHA = 0.1;
+// how long stepping a chunk of games should take with the steal scheduler
+const double TARGET_CHUNK_NS = 20000.0;
+
+// values of VecGame::current_buffers
+const uint8_t MainBuffers = 1;
+const uint8_t SlotBuffers = 2;
 
 extern void coinrun_old_init(int rand_seed);
 
@@ -100,47 +112,304 @@ void libenv_close(libenv_env *handle) {
 
 // end libenv api
 
-static void stepping_worker(std::mutex &stepping_thread_mutex,
-                            std::list<std::shared_ptr<Game>> &pending_games,
-                            std::condition_variable &pending_games_added,
-                            std::condition_variable &pending_game_complete, bool &time_to_die) {
+// spin for a while before sleeping on cv, since the thing we wait for is often only microseconds away
+template <typename F>
+void VecGame::wait_until(SpinWait &spin_wait, std::condition_variable &cv, F done) {
+    if (spin_wait.spin(done)) {
+        return;
+    }
+
+    // whoever makes done() true takes the lock before notifying, so checking under the lock can't miss a wakeup
+    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    cv.wait(lock, done);
+    spin_wait.finish_blocking();
+}
+
+void VecGame::worker_main(int thread_idx) {
+    if (worker_cpus[thread_idx] >= 0) {
+        if (!pin_current_thread(worker_cpus[thread_idx])) {
+            fatal("thread_affinity and numa_node are not supported on this platform\n");
+        }
+    }
+
+    if (init_slice) {
+        init_slice(thread_idx);
+        finish_work_item(outstanding_inits);
+    }
+
+    if (scheduler == StaticScheduler || scheduler == StealScheduler) {
+        static_stepping_worker(thread_idx);
+    } else {
+        stepping_worker();
+    }
+}
+
+bool VecGame::has_pending_games() {
+    for (const auto &slot : slots) {
+        if (!slot->pending_games.empty()) {
+            return true;
+        }
+    }
+    return !sent_games.empty();
+}
+
+// take a game from any slot, starting with first_slot so that a thread keeps working on one slot until it's empty
+bool VecGame::pop_pending_game(int first_slot, int *slot, int *env_idx) {
+    for (int i = 0; i < num_slots; i++) {
+        int s = (first_slot + i) % num_slots;
+        if (slots[s]->pending_games.pop(env_idx)) {
+            *slot = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+// step one game from act() or send(), slot is where to look first and is updated to where the game came from
+bool VecGame::step_pending_game(int *slot) {
+    int env_idx;
+
+    if (pop_pending_game(*slot, slot, &env_idx)) {
+        step_game(games[env_idx]);
+        finish_work_item(slots[*slot]->outstanding_steps);
+        return true;
+    }
+
+    if (sent_games.pop(&env_idx)) {
+        step_game(games[env_idx]);
+        finish_sent_game(env_idx);
+        return true;
+    }
+
+    return false;
+}
+
+bool VecGame::run_pending_work() {
+    int slot = pool_slot.load(std::memory_order_relaxed);
+    bool ran = step_pending_game(&slot);
+    pool_slot.store(slot, std::memory_order_relaxed);
+    return ran;
+}
+
+void VecGame::stepping_worker() {
+    SpinWait spin_wait;
+    spin_wait.configure(spin_wait_us);
+    int slot = 0;
+
     while (1) {
-        std::shared_ptr<Game> game;
+        if (step_pending_game(&slot)) {
+            continue;
+        }
 
-        {
-            std::unique_lock<std::mutex> lock(stepping_thread_mutex);
-            while (1) {
-                if (time_to_die) {
-                    return;
-                }
-                if (!pending_games.empty()) {
-                    game = pending_games.front();
-                    pending_games.pop_front();
-                    break;
-                }
+        wait_until(spin_wait, pending_games_added, [&]() { return time_to_die.load() || has_pending_games(); });
+        if (time_to_die.load()) {
+            return;
+        }
+    }
+}
+
+void VecGame::static_stepping_worker(int thread_idx) {
+    SpinWait spin_wait;
+    spin_wait.configure(spin_wait_us);
+    std::vector<uint64_t> seen_generations(num_slots, 0);
 
-                pending_games_added.wait(lock);
+    auto has_new_generation = [&]() {
+        for (int s = 0; s < num_slots; s++) {
+            if (slots[s]->step_generation.load(std::memory_order_acquire) != seen_generations[s]) {
+                return true;
             }
         }
+        return false;
+    };
 
-        // the first time the threads are activated is before any step, just to initialize
-        // the environment and produce the initial observation
-        if (!game->initial_reset_complete) {
-            game->reset();
-            game->observe();
-            game->initial_reset_complete = true;
-        } else{
-            game->step();
+    while (1) {
+        wait_until(spin_wait, pending_games_added, [&]() { return time_to_die.load() || has_new_generation(); });
+        if (time_to_die.load()) {
+            return;
         }
 
-        {
-            std::unique_lock<std::mutex> lock(stepping_thread_mutex);
-            game->is_waiting_for_step = false;
-            pending_game_complete.notify_all();
+        for (int s = 0; s < num_slots; s++) {
+            uint64_t generation = slots[s]->step_generation.load(std::memory_order_acquire);
+            if (generation == seen_generations[s]) {
+                continue;
+            }
+            seen_generations[s] = generation;
+
+            if (scheduler == StealScheduler) {
+                step_range(s, thread_idx);
+            } else {
+                step_slice(s, thread_idx);
+                finish_work_item(slots[s]->outstanding_steps);
+            }
         }
     }
 }
 
+// the games in each slot are split into one contiguous slice per thread, the calling thread has the last one
+void VecGame::get_slice(int slot, int slice_idx, int *start, int *end) {
+    int num_slices = (int)(threads.size()) + 1;
+    int slot_start = slots[slot]->start;
+    int slot_size = slots[slot]->end - slot_start;
+    *start = slot_start + slice_idx * slot_size / num_slices;
+    *end = slot_start + (slice_idx + 1) * slot_size / num_slices;
+}
+
+void VecGame::step_slice(int slot, int slice_idx) {
+    // each slice is always stepped by the same thread
+    int start, end;
+    get_slice(slot, slice_idx, &start, &end);
+    for (int e = start; e < end; e++) {
+        step_game(games[e]);
+    }
+}
+
+static void update_average(double *average, double sample) {
+    *average = *average == 0.0 ? sample : (1.0 - COST_EMA_ALPHA) * *average + COST_EMA_ALPHA * sample;
+}
+
+static uint64_t pack_range(int begin, int end) {
+    return ((uint64_t)(uint32_t)begin << 32) | (uint32_t)end;
+}
+
+static void unpack_range(uint64_t bounds, int *begin, int *end) {
+    *begin = (int)(bounds >> 32);
+    *end = (int)(uint32_t)bounds;
+}
+
+// take up to chunk games from the front of our own range, if it's empty empty_bounds is set to the
+// value that was found
+static bool pop_chunk(WorkRange &range, int chunk, int *start, int *end, uint64_t *empty_bounds) {
+    uint64_t bounds = range.bounds.load(std::memory_order_acquire);
+    while (1) {
+        int b, e;
+        unpack_range(bounds, &b, &e);
+        if (b >= e) {
+            *empty_bounds = bounds;
+            return false;
+        }
+        int next = std::min(b + chunk, e);
+        if (range.bounds.compare_exchange_weak(bounds, pack_range(next, e), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            *start = b;
+            *end = next;
+            return true;
+        }
+    }
+}
+
+// take the back half of another thread's range, or the last game if that's all there is
+static bool steal_half(WorkRange &range, int *start, int *end) {
+    uint64_t bounds = range.bounds.load(std::memory_order_acquire);
+    while (1) {
+        int b, e;
+        unpack_range(bounds, &b, &e);
+        if (b >= e) {
+            return false;
+        }
+        int mid = b + (e - b) / 2;
+        if (range.bounds.compare_exchange_weak(bounds, pack_range(b, mid), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            *start = mid;
+            *end = e;
+            return true;
+        }
+    }
+}
+
+// step chunks of our own range and then steal from the other threads until no games are left
+void VecGame::step_range(int slot, int worker_idx) {
+    StepSlot &s = *slots[slot];
+    int num_workers = (int)(threads.size()) + 1;
+    int start, end;
+    uint64_t empty_bounds;
+
+    while (1) {
+        if (pop_chunk(s.ranges[worker_idx], s.chunk_size.load(std::memory_order_relaxed), &start, &end, &empty_bounds)) {
+            for (int e = start; e < end; e++) {
+                step_game(games[e]);
+            }
+            finish_work_item(s.outstanding_steps, end - start);
+            continue;
+        }
+
+        bool stolen = false;
+        for (int i = 1; i < num_workers && !stolen; i++) {
+            stolen = steal_half(s.ranges[(worker_idx + i) % num_workers], &start, &end);
+        }
+        if (!stolen) {
+            return;
+        }
+        // put the stolen games in our range so that they can be stolen again from here, unless the range
+        // changed since we found it empty, which happens when we are still stealing while the next step
+        // starts and hands us a new slice, in that case we step the stolen games ourselves
+        if (!s.ranges[worker_idx].bounds.compare_exchange_strong(empty_bounds, pack_range(start, end), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            for (int e = start; e < end; e++) {
+                step_game(games[e]);
+            }
+            finish_work_item(s.outstanding_steps, end - start);
+        }
+    }
+}
+
+// chunks should take long enough that taking one is cheap compared to stepping it, but each thread
+// should start with several of them so that there is something left to steal
+int VecGame::choose_chunk_size(int slot) {
+    const StepSlot &s = *slots[slot];
+    int slot_size = s.end - s.start;
+    double total_ns = 0.0;
+    for (int e = s.start; e < s.end; e++) {
+        total_ns += game_costs[e].expected_ns;
+    }
+    double average_ns = total_ns / slot_size;
+
+    int max_chunk = std::max(1, slot_size / (4 * ((int)(threads.size()) + 1)));
+    if (average_ns <= 0.0) {
+        return 1;
+    }
+    return std::max(1, std::min((int)(TARGET_CHUNK_NS / average_ns), max_chunk));
+}
+
+void VecGame::step_game(const std::shared_ptr<Game> &game) {
+    auto start = std::chrono::steady_clock::now();
+    bool did_reset;
+
+    // the first time the threads are activated is before any step, just to initialize
+    // the environment and produce the initial observation
+    if (!game->initial_reset_complete) {
+        game->reset();
+        game->observe();
+        game->initial_reset_complete = true;
+        did_reset = true;
+    } else{
+        game->step();
+        did_reset = game->step_data.done;
+    }
+
+    double elapsed_ns = (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    GameCost &cost = game_costs[game->game_n];
+    update_average(did_reset ? &cost.reset_ns : &cost.step_ns, elapsed_ns);
+    update_average(&cost.expected_ns, elapsed_ns);
+
+    game->is_waiting_for_step = false;
+}
+
+void VecGame::finish_work_item(std::atomic<int> &outstanding, int count) {
+    // only the last work item to finish wakes up the waiting thread
+    if (outstanding.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+        pending_game_complete.notify_all();
+    }
+}
+
+void VecGame::finish_sent_game(int env_idx) {
+    // the id has to be in the queue before recv() can see it counted
+    fassert(completed_games.push(env_idx));
+    int completed = num_completed.fetch_add(1, std::memory_order_acq_rel) + 1;
+    int outstanding = outstanding_sends.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (completed == batch_size || outstanding == 0) {
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+        pending_game_complete.notify_all();
+    }
+}
+
 void global_init(int rand_seed, std::string resource_root) {
     global_resource_root = resource_root;
 
@@ -166,10 +435,11 @@ inline uint32_t hash_str_uint32(const std::string &str) {
     return hash;
 }
 
-VecGame::VecGame(int _nenvs, VecOptions opts) {
+VecGame::VecGame(int _nenvs, VecOptions opts) : sent_games(_nenvs), completed_games(_nenvs) {
     render_human = false;
     num_envs = _nenvs;
     games.resize(num_envs);
+    game_costs.resize(num_envs);
     std::string env_name;
 
     int num_levels = 0;
@@ -179,6 +449,19 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     int rand_seed = 0;
     int num_threads = 4;
     std::string resource_root;
+    int frame_stack = 1;
+    std::string obs_spaces = "rgb";
+    std::string render_human_env_ids;
+    int render_human_interval = 1;
+    std::string scheduler_name;
+    std::string thread_affinity;
+    int numa_node = -1;
+    bool shared_pool = false;
+    int pool_threads = -1;
+    int pool_priority = 0;
+    num_slots = 1;
+    batch_size = 0;
+    spin_wait_us = -1;
 
     opts.consume_string("env_name", &env_name);
     opts.consume_int("num_levels", &num_levels);
@@ -188,36 +471,158 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     opts.consume_int("num_threads", &num_threads);
     opts.consume_string("resource_root", &resource_root);
     opts.consume_bool("render_human", &render_human);
+    opts.consume_int("frame_stack", &frame_stack);
+    opts.consume_string("obs_spaces", &obs_spaces);
+    opts.consume_string("render_human_env_ids", &render_human_env_ids);
+    opts.consume_int("render_human_interval", &render_human_interval);
+    opts.consume_string("scheduler", &scheduler_name);
+    opts.consume_int("spin_wait_us", &spin_wait_us);
+    opts.consume_string("thread_affinity", &thread_affinity);
+    opts.consume_int("numa_node", &numa_node);
+    opts.consume_int("num_slots", &num_slots);
+    opts.consume_int("batch_size", &batch_size);
+    opts.consume_bool("shared_pool", &shared_pool);
+    opts.consume_int("pool_threads", &pool_threads);
+    opts.consume_int("pool_priority", &pool_priority);
 
     std::call_once(global_init_flag, global_init, rand_seed,
                    resource_root);
 
+    if (scheduler_name == "") {
+        // steal balances uneven games about as well as the queue while keeping the locality of static slices,
+        // but sharing the pool and receiving games in batches rely on the queue
+        scheduler_name = shared_pool || batch_size > 0 ? "queue" : "steal";
+    }
+    if (scheduler_name == "queue") {
+        scheduler = QueueScheduler;
+    } else if (scheduler_name == "static") {
+        scheduler = StaticScheduler;
+    } else if (scheduler_name == "steal") {
+        scheduler = StealScheduler;
+    } else {
+        fatal("invalid scheduler %s\n", scheduler_name.c_str());
+    }
+
+    fassert(num_slots >= 1);
+    fassert(batch_size >= 0 && batch_size <= num_envs);
+    game_sent.resize(num_envs, false);
+    main_buffers.resize(num_envs);
+    slot_buffers.resize(num_envs);
+    has_slot_buffers.resize(num_slots, false);
+    current_buffers.resize(num_envs, MainBuffers);
+    fassert(num_envs % num_slots == 0);
+    int slot_size = num_envs / num_slots;
+    for (int s = 0; s < num_slots; s++) {
+        slots.push_back(std::unique_ptr<StepSlot>(new StepSlot(s * slot_size, (s + 1) * slot_size)));
+    }
+
     fassert(num_threads >= 0);
-    threads.resize(num_threads);
-    for (int t = 0; t < num_threads; t++) {
-        threads[t] = std::thread(
-            stepping_worker,
-            std::ref(stepping_thread_mutex),
-            std::ref(pending_games),
-            std::ref(pending_games_added),
-            std::ref(pending_game_complete),
-            std::ref(time_to_die));
+    if (shared_pool) {
+        if (scheduler != QueueScheduler) {
+            fatal("shared_pool requires the queue scheduler\n");
+        }
+        if (thread_affinity != "" || numa_node >= 0) {
+            fatal("thread_affinity and numa_node can't be used with shared_pool\n");
+        }
+        // the pool threads are shared with other environments, so we don't start any of our own
+        pool = &WorkerPool::global();
+        if (!pool->start(pool_threads)) {
+            fatal("the shared pool already has %d threads, pool_threads=%d was requested\n", pool->num_threads(), pool_threads);
+        }
+        num_threads = 0;
+    } else if (pool_threads != -1) {
+        fatal("pool_threads requires shared_pool\n");
+    }
+    if (scheduler == StaticScheduler) {
+        // every slice, including the one for the calling thread, needs at least one game
+        num_threads = std::min(num_threads, slot_size - 1);
+    }
+    if (scheduler == StealScheduler) {
+        for (auto &slot : slots) {
+            slot->ranges.reset(new WorkRange[num_threads + 1]);
+        }
+    }
+    int total_threads = pool != nullptr ? pool->num_threads() : num_threads;
+    if (spin_wait_us < 0 && total_threads + 1 > (int)(std::thread::hardware_concurrency())) {
+        // with more threads than cores, a spinning thread takes time away from the one it waits for
+        spin_wait_us = 0;
+    }
+    caller_spin_wait.configure(spin_wait_us);
+
+    std::vector<int> allowed_cpus;
+    if (thread_affinity != "") {
+        allowed_cpus = parse_cpu_list(thread_affinity);
+    }
+    if (numa_node >= 0) {
+        std::vector<int> node_cpus = numa_node_cpus(numa_node);
+        if (allowed_cpus.empty()) {
+            allowed_cpus = node_cpus;
+        } else {
+            // use the requested cpus that are on the requested node
+            std::vector<int> both;
+            for (int cpu : allowed_cpus) {
+                if (std::find(node_cpus.begin(), node_cpus.end(), cpu) != node_cpus.end()) {
+                    both.push_back(cpu);
+                }
+            }
+            allowed_cpus = both;
+        }
+        fassert(allowed_cpus.size() > 0);
+    }
+
+    // give each thread its own cpu where possible
+    worker_cpus.resize(num_threads, -1);
+    for (int t = 0; t < num_threads && allowed_cpus.size() > 0; t++) {
+        worker_cpus[t] = allowed_cpus[t % allowed_cpus.size()];
     }
 
     fassert(env_name != "");
     fassert(num_actions > 0);
     fassert(num_levels >= 0);
     fassert(start_level >= 0);
+    fassert(frame_stack >= 1);
+    fassert(render_human_interval >= 1);
+
+    // by default every environment renders a human frame
+    std::vector<bool> env_renders_human(num_envs, render_human);
+    if (render_human && render_human_env_ids != "") {
+        std::fill(env_renders_human.begin(), env_renders_human.end(), false);
+        for (const auto &id : split(render_human_env_ids, ",")) {
+            int env_idx = std::stoi(id);
+            fassert(env_idx >= 0 && env_idx < num_envs);
+            env_renders_human[env_idx] = true;
+        }
+    }
+
+    std::vector<std::string> obs_names = split(obs_spaces, ",");
+    fassert(obs_names.size() > 0);
+
+    for (const auto &obs_name : obs_names) {
+        // stacked frames are ordered from oldest to newest
+        std::vector<int> shape;
+        if (frame_stack > 1) {
+            shape.push_back(frame_stack);
+        }
+
+        if (obs_name == "rgb") {
+            shape.insert(shape.end(), {RES_W, RES_H, 3});
+        } else if (obs_name == "gray") {
+            shape.insert(shape.end(), {RES_W, RES_H});
+        } else if (obs_name == "rgb_32") {
+            // box filtered to half resolution
+            shape.insert(shape.end(), {RES_W / 2, RES_H / 2, 3});
+        } else {
+            fatal("invalid observation space %s\n", obs_name.c_str());
+        }
 
-    {
         struct libenv_tensortype s;
-        strcpy(s.name, "rgb");
+        strcpy(s.name, obs_name.c_str());
         s.scalar_type = LIBENV_SCALAR_TYPE_DISCRETE;
         s.dtype = LIBENV_DTYPE_UINT8;
-        s.shape[0] = RES_W;
-        s.shape[1] = RES_H;
-        s.shape[2] = 3;
-        s.ndim = 3;
+        for (size_t i = 0; i < shape.size(); i++) {
+            s.shape[i] = shape[i];
+        }
+        s.ndim = shape.size();
         s.low.uint8 = 0;
         s.high.uint8 = 255;
         observation_types.push_back(s);
@@ -301,22 +706,31 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
     RandGen game_level_seed_gen;
     game_level_seed_gen.seed(rand_seed);
 
+    // draw the seeds up front so that they don't depend on which thread creates which game
+    std::vector<int> game_level_seeds(num_envs);
+    for (int n = 0; n < num_envs; n++) {
+        game_level_seeds[n] = game_level_seed_gen.randint();
+    }
+
     std::map<std::string, int> info_name_to_offset;
     for (size_t i = 0; i < info_types.size(); i++) {
         info_name_to_offset[info_types[i].name] = i;
     }
 
-    for (int n = 0; n < num_envs; n++) {
+    auto init_game = [&](int n) {
         auto name = env_names[n % num_joint_games];
 
         games[n] = globalGameRegistry->at(name)();
         fassert(games[n]->game_name == name);
-        games[n]->level_seed_rand_gen.seed(game_level_seed_gen.randint());
+        games[n]->level_seed_rand_gen.seed(game_level_seeds[n]);
         games[n]->level_seed_high = level_seed_high;
         games[n]->level_seed_low = level_seed_low;
         games[n]->game_n = n;
         games[n]->is_waiting_for_step = false;
         games[n]->parse_options(name, opts);
+        games[n]->set_observation_spaces(obs_names, frame_stack);
+        games[n]->render_human = env_renders_human[n];
+        games[n]->render_human_interval = render_human_interval;
         games[n]->info_name_to_offset = info_name_to_offset;
 
         // Auto-selected a fixed_asset_seed if one wasn't specified on
@@ -327,81 +741,304 @@ VecGame::VecGame(int _nenvs, VecOptions opts) {
         }
 
         games[n]->game_init();
+    };
+
+    // with pinned threads, each thread creates a slice of the games so that their memory is allocated on
+    // its NUMA node, the static scheduler keeps stepping the same slices on the same threads afterwards
+    if (allowed_cpus.size() > 0 && num_threads > 0) {
+        init_slice = [&](int slice_idx) {
+            for (int s = 0; s < num_slots; s++) {
+                int start, end;
+                get_slice(s, slice_idx, &start, &end);
+                for (int n = start; n < end; n++) {
+                    init_game(n);
+                }
+            }
+        };
+        outstanding_inits.store(num_threads + 1);
+    }
+
+    threads.resize(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+        threads[t] = std::thread(&VecGame::worker_main, this, t);
+    }
+
+    if (init_slice) {
+        init_slice(num_threads);
+        finish_work_item(outstanding_inits);
+        wait_until(caller_spin_wait, pending_game_complete, [&]() { return outstanding_inits.load(std::memory_order_acquire) == 0; });
+        init_slice = nullptr;
+    } else {
+        for (int n = 0; n < num_envs; n++) {
+            init_game(n);
+        }
+    }
+
+    if (pool != nullptr) {
+        pool->add_client(this, pool_priority);
     }
 }
 
 void VecGame::set_buffers(const std::vector<std::vector<void *>> &ac, const std::vector<std::vector<void *>> &ob, const std::vector<std::vector<void *>> &info, float *rew, uint8_t *first) {
     {
-        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
-
         for (int e = 0; e < num_envs; e++) {
             const auto &game = games[e];
+            auto &bufs = main_buffers[e];
             // we only ever have one action
-            game->action_ptr = (int32_t *)(ac[e][0]);
-            game->obs_bufs = ob[e];
-            game->info_bufs = info[e];
-            game->reward_ptr = &rew[e];
-            game->first_ptr = &first[e];
+            bufs.action = (int32_t *)(ac[e][0]);
+            bufs.obs = ob[e];
+            bufs.info = info[e];
+            bufs.rew = &rew[e];
+            bufs.first = &first[e];
+            use_buffers(e, false);
             
-            // render the initial state so we don't see a black screen on the first frame
             fassert(!game->is_waiting_for_step);
             fassert(!game->initial_reset_complete);
-            if (threads.size() == 0) {
-                // special case for no threads
-                game->reset();
-                game->observe();
-                game->initial_reset_complete = true;
-            } else {
-                game->is_waiting_for_step = true;
-                pending_games.push_back(game);
-            }
         }
     }
-    pending_games_added.notify_all();
+    // render the initial state so we don't see a black screen on the first frame
+    for (int s = 0; s < num_slots; s++) {
+        start_stepping(s);
+    }
+}
+
+void VecGame::set_slot_buffers(int slot, const std::vector<std::vector<void *>> &ac, const std::vector<std::vector<void *>> &ob, const std::vector<std::vector<void *>> &info, float *rew, uint8_t *first) {
+    fassert(slot >= 0 && slot < num_slots);
+    wait_for_slot(slot);
+
+    int start = slots[slot]->start;
+    for (int e = start; e < slots[slot]->end; e++) {
+        auto &bufs = slot_buffers[e];
+        // the results are either in the main buffers or in the slot buffers that are being replaced
+        GameBuffers src = (current_buffers[e] & MainBuffers) ? main_buffers[e] : bufs;
+        int i = e - start;
+        bufs.action = (int32_t *)(ac[i][0]);
+        bufs.obs = ob[i];
+        // without info buffers of its own, the slot keeps writing info to the main buffers
+        bufs.info = info.empty() ? main_buffers[e].info : info[i];
+        bufs.rew = &rew[i];
+        bufs.first = &first[i];
+
+        fassert(games[e]->initial_reset_complete);
+        // bring the new buffers up to date, set_buffers() has already started the initial reset
+        copy_results(e, src, bufs);
+        current_buffers[e] |= SlotBuffers;
+    }
+    has_slot_buffers[slot] = true;
+}
+
+// point a game at either its main or its slot buffers, the game must not be stepping
+void VecGame::use_buffers(int env_idx, bool use_slot_buffers) {
+    const auto &game = games[env_idx];
+    const auto &bufs = use_slot_buffers ? slot_buffers[env_idx] : main_buffers[env_idx];
+    game->action_ptr = bufs.action;
+    game->obs_bufs = bufs.obs;
+    game->info_bufs = bufs.info;
+    game->reward_ptr = bufs.rew;
+    game->first_ptr = bufs.first;
+}
+
+static size_t tensortype_size(const struct libenv_tensortype &type) {
+    size_t size = type.dtype == LIBENV_DTYPE_UINT8 ? 1 : 4;
+    for (int i = 0; i < type.ndim; i++) {
+        size *= type.shape[i];
+    }
+    return size;
+}
+
+// copy the results of the latest step of a game from one set of buffers to another
+void VecGame::copy_results(int env_idx, const GameBuffers &src, const GameBuffers &dst) {
+    for (size_t k = 0; k < observation_types.size(); k++) {
+        memcpy(dst.obs[k], src.obs[k], tensortype_size(observation_types[k]));
+    }
+    if (dst.info != src.info) {
+        for (size_t k = 0; k < info_types.size(); k++) {
+            memcpy(dst.info[k], src.info[k], tensortype_size(info_types[k]));
+        }
+    }
+    *dst.rew = *src.rew;
+    *dst.first = *src.first;
 }
 
 void VecGame::observe() {
+    // the observations, including any human frames, are written by Game::observe while stepping
     wait_for_stepping_threads();
-    // at this point all games belong to the python thread
 
-    if (render_human) {
-        uint8_t render_hires_buf[RENDER_RES * RENDER_RES * 4];
-
-        for (int e = 0; e < num_envs; e++) {
-            const auto &game = games[e];
-            game->render_to_buf(render_hires_buf, RENDER_RES, RENDER_RES, true);
-            bgr32_to_rgb888(game->info_bufs[game->info_name_to_offset.at("rgb")], render_hires_buf, RENDER_RES, RENDER_RES);
+    // games last stepped with act_async() or send() wrote their results to their slot buffers
+    for (int e = 0; e < num_envs; e++) {
+        if (!(current_buffers[e] & MainBuffers)) {
+            copy_results(e, slot_buffers[e], main_buffers[e]);
+            current_buffers[e] |= MainBuffers;
         }
     }
 }
 
 void VecGame::act() {
-    wait_for_stepping_threads();
+    fassert(batch_size == 0);
+    for (int s = 0; s < num_slots; s++) {
+        act_slot(s, false);
+    }
+}
 
-    {
-        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+// start stepping one slot of games, this returns without waiting for them
+void VecGame::act_slot(int slot, bool use_slot_buffers) {
+    fassert(slot >= 0 && slot < num_slots);
+    fassert(!use_slot_buffers || has_slot_buffers[slot]);
+    wait_for_slot(slot);
 
-        for (int e = 0; e < num_envs; e++) {
+    {
+        for (int e = slots[slot]->start; e < slots[slot]->end; e++) {
             const auto &game = games[e];
             fassert(!game->is_waiting_for_step);
+            use_buffers(e, use_slot_buffers);
+            current_buffers[e] = use_slot_buffers ? SlotBuffers : MainBuffers;
             // save the action since it's only valid for the duration of this call
             game->action = *game->action_ptr;
-            if (threads.size() == 0) {
-                // special case for no threads
-                game->step();
-            } else {
-                game->is_waiting_for_step = true;
-                pending_games.push_back(game);
-            }
+        }
+    }
+
+    start_stepping(slot);
+}
+
+void VecGame::wait_for_slot_buffers(int slot) {
+    fassert(slot >= 0 && slot < num_slots);
+    fassert(has_slot_buffers[slot]);
+    wait_for_slot(slot);
+
+    // games last stepped with act() wrote their results to the main buffers
+    for (int e = slots[slot]->start; e < slots[slot]->end; e++) {
+        if (!(current_buffers[e] & SlotBuffers)) {
+            copy_results(e, main_buffers[e], slot_buffers[e]);
+            current_buffers[e] |= SlotBuffers;
+        }
+    }
+}
+
+// hand the slot's games over to the stepping threads, the calling thread joins in once it waits for them
+void VecGame::start_stepping(int slot) {
+    StepSlot &s = *slots[slot];
+    for (int e = s.start; e < s.end; e++) {
+        games[e]->is_waiting_for_step = true;
+    }
+
+    if (scheduler == StaticScheduler) {
+        // one work item per slice of games, including the calling thread's
+        s.outstanding_steps.store((int)(threads.size()) + 1, std::memory_order_relaxed);
+        s.caller_slice_pending = true;
+        s.step_generation.fetch_add(1, std::memory_order_release);
+    } else if (scheduler == StealScheduler) {
+        s.outstanding_steps.store(s.end - s.start, std::memory_order_relaxed);
+        s.chunk_size.store(choose_chunk_size(slot), std::memory_order_relaxed);
+        // each thread starts with the same slice as it would have with the static scheduler
+        for (int w = 0; w < (int)(threads.size()) + 1; w++) {
+            int begin, end;
+            get_slice(slot, w, &begin, &end);
+            s.ranges[w].bounds.store(pack_range(begin, end), std::memory_order_release);
+        }
+        s.caller_slice_pending = true;
+        s.step_generation.fetch_add(1, std::memory_order_release);
+    } else {
+        // longest processing time first, so that the last games to be picked up are cheap ones and the
+        // threads finish at about the same time
+        std::sort(s.dispatch_order.begin(), s.dispatch_order.end(), [&](int a, int b) {
+            double cost_a = game_costs[a].expected_ns;
+            double cost_b = game_costs[b].expected_ns;
+            return cost_a > cost_b || (cost_a == cost_b && a < b);
+        });
+
+        s.outstanding_steps.store(s.end - s.start, std::memory_order_relaxed);
+        for (int e : s.dispatch_order) {
+            // the queue holds at most one entry per game, so it can't be full
+            fassert(s.pending_games.push(e));
         }
     }
     // at this point all games belong to the stepping threads
 
+    notify_stepping_threads();
+}
+
+void VecGame::notify_stepping_threads() {
+    if (pool != nullptr) {
+        pool->notify_work_added();
+        return;
+    }
+
+    if (threads.size() == 0) {
+        return;
+    }
+
+    {
+        // taking the lock orders this notification after any worker that is about to wait has checked
+        // for work
+        std::unique_lock<std::mutex> lock(stepping_thread_mutex);
+    }
     pending_games_added.notify_all();
 }
 
+// start stepping some games, they are returned by recv() once they are done
+void VecGame::send(const int32_t *actions, const int *env_ids, int count) {
+    fassert(batch_size > 0);
+    if (scheduler != QueueScheduler) {
+        fatal("send and recv require the queue scheduler\n");
+    }
+
+    for (int i = 0; i < count; i++) {
+        int env_idx = env_ids[i];
+        fassert(env_idx >= 0 && env_idx < num_envs);
+        fassert(!game_sent[env_idx]);
+        // the game may still be doing its initial reset or a step from act()
+        int slot = env_idx / (num_envs / num_slots);
+        wait_for_slot(slot);
+        const auto &game = games[env_idx];
+        fassert(!game->is_waiting_for_step);
+
+        // results go to the slot buffers when the caller set them, otherwise to the main ones
+        bool use_slot_buffers = has_slot_buffers[slot];
+        use_buffers(env_idx, use_slot_buffers);
+        current_buffers[env_idx] = use_slot_buffers ? SlotBuffers : MainBuffers;
+        game->action = actions[i];
+        game->is_waiting_for_step = true;
+        game_sent[env_idx] = true;
+        outstanding_sends.fetch_add(1, std::memory_order_relaxed);
+        // each game is in the queue at most once, so it can't be full
+        fassert(sent_games.push(env_idx));
+    }
+
+    notify_stepping_threads();
+}
+
+// wait until batch_size of the sent games have finished and fill in their ids, the games that finish
+// first are returned first so that slow games don't hold up the others
+int VecGame::recv(int *env_ids) {
+    fassert(batch_size > 0);
+    auto batch_ready = [&]() { return num_completed.load(std::memory_order_acquire) >= batch_size; };
+    fassert(num_completed.load() + outstanding_sends.load() >= batch_size);
+
+    // like wait_for_slot(), step games ourselves until enough of them are done
+    int env_idx;
+    while (!batch_ready() && sent_games.pop(&env_idx)) {
+        step_game(games[env_idx]);
+        finish_sent_game(env_idx);
+    }
+
+    if (!batch_ready()) {
+        wait_until(caller_spin_wait, pending_game_complete, batch_ready);
+    }
+
+    for (int i = 0; i < batch_size; i++) {
+        fassert(completed_games.pop(&env_ids[i]));
+        game_sent[env_ids[i]] = false;
+    }
+    num_completed.fetch_sub(batch_size, std::memory_order_acq_rel);
+    return batch_size;
+}
+
 VecGame::~VecGame() {
     wait_for_stepping_threads();
+    if (pool != nullptr) {
+        // a pool thread may still be looking for work from us
+        pool->remove_client(this);
+    }
     {
         std::unique_lock<std::mutex> lock(stepping_thread_mutex);
         time_to_die = true;
@@ -414,24 +1051,49 @@ VecGame::~VecGame() {
 }
 
 void VecGame::wait_for_stepping_threads() {
-    if (threads.size() == 0) {
-        return;
+    for (int s = 0; s < num_slots; s++) {
+        wait_for_slot(s);
     }
 
-    std::unique_lock<std::mutex> lock(stepping_thread_mutex);
-    while (1) {
-        bool all_steps_completed = true;
+    // games from send() may still be stepping as well
+    int env_idx;
+    while (sent_games.pop(&env_idx)) {
+        step_game(games[env_idx]);
+        finish_sent_game(env_idx);
+    }
+    if (outstanding_sends.load(std::memory_order_acquire) > 0) {
+        wait_until(caller_spin_wait, pending_game_complete, [&]() { return outstanding_sends.load(std::memory_order_acquire) == 0; });
+    }
+}
 
-        for (int e = 0; e < num_envs; e++) {
-            const auto &game = games[e];
-            all_steps_completed &= !game->is_waiting_for_step;
-        }
+void VecGame::wait_for_slot(int slot) {
+    StepSlot &s = *slots[slot];
 
-        if (all_steps_completed)
-            break;
+    // step games ourselves rather than sit idle, with no threads this does all of the work
+    if (scheduler == StaticScheduler) {
+        if (s.caller_slice_pending) {
+            s.caller_slice_pending = false;
+            step_slice(slot, (int)(threads.size()));
+            finish_work_item(s.outstanding_steps);
+        }
+    } else if (scheduler == StealScheduler) {
+        if (s.caller_slice_pending) {
+            s.caller_slice_pending = false;
+            step_range(slot, (int)(threads.size()));
+        }
+    } else {
+        int env_idx;
+        while (s.pending_games.pop(&env_idx)) {
+            step_game(games[env_idx]);
+            finish_work_item(s.outstanding_steps);
+        }
+    }
 
-        pending_game_complete.wait(lock);
+    if (s.outstanding_steps.load(std::memory_order_acquire) == 0) {
+        return;
     }
+
+    wait_until(caller_spin_wait, pending_game_complete, [&]() { return s.outstanding_steps.load(std::memory_order_acquire) == 0; });
 }
 
 extern "C" {
@@ -454,4 +1116,69 @@ extern "C" {
         // next time VecGame::observe() is called, the correct data will be in the buffers
         venv->games.at(env_idx)->observe();
     }
+
+    // the buffers for a slot are laid out like the ones for libenv_set_buffers() but only hold the
+    // games in that slot, info may be null to keep writing info to the buffers from libenv_set_buffers()
+    LIBENV_API void set_slot_buffers(libenv_env *handle, int slot, struct libenv_buffers *bufs) {
+        auto venv = (VecGame *)(handle);
+        int slot_size = venv->num_envs / venv->num_slots;
+        auto ac = convert_bufs(bufs->ac, slot_size, venv->action_types.size());
+        auto ob = convert_bufs(bufs->ob, slot_size, venv->observation_types.size());
+        std::vector<std::vector<void *>> info;
+        if (bufs->info != nullptr) {
+            info = convert_bufs(bufs->info, slot_size, venv->info_types.size());
+        }
+        venv->set_slot_buffers(slot, ac, ob, info, bufs->rew, bufs->first);
+    }
+
+    // read the actions for a slot and start stepping its games, this returns immediately
+    LIBENV_API void act_async(libenv_env *handle, int slot) {
+        auto venv = (VecGame *)(handle);
+        venv->act_slot(slot, true);
+    }
+
+    // wait until the games in a slot have finished stepping and written their observations
+    LIBENV_API void wait_async(libenv_env *handle, int slot) {
+        auto venv = (VecGame *)(handle);
+        venv->wait_for_slot_buffers(slot);
+    }
+
+    // start stepping the games in env_ids with the given actions, this returns immediately
+    LIBENV_API void send_async(libenv_env *handle, int32_t *actions, int *env_ids, int count) {
+        auto venv = (VecGame *)(handle);
+        venv->send(actions, env_ids, count);
+    }
+
+    // wait for batch_size games from send_async() to finish and write their ids to env_ids, returns batch_size
+    LIBENV_API int recv_async(libenv_env *handle, int *env_ids) {
+        auto venv = (VecGame *)(handle);
+        return venv->recv(env_ids);
+    }
+
+    // fills in the moving averages of how long each game takes to step in microseconds, each array has num_envs entries
+    LIBENV_API void get_cost_estimates(libenv_env *handle, float *step_us, float *reset_us, float *expected_us) {
+        auto venv = (VecGame *)(handle);
+        venv->wait_for_stepping_threads();
+        for (int e = 0; e < venv->num_envs; e++) {
+            const auto &cost = venv->game_costs[e];
+            step_us[e] = (float)(cost.step_ns / 1000.0);
+            reset_us[e] = (float)(cost.reset_ns / 1000.0);
+            expected_us[e] = (float)(cost.expected_ns / 1000.0);
+        }
+    }
+
+    // fills in the cpu each stepping thread is pinned to, or -1 if it isn't pinned, returns the number of threads
+    LIBENV_API int get_worker_cpus(libenv_env *handle, int *cpus, int max_count) {
+        auto venv = (VecGame *)(handle);
+        int count = (int)(venv->worker_cpus.size());
+        for (int t = 0; t < count && t < max_count; t++) {
+            cpus[t] = venv->worker_cpus[t];
+        }
+        return count;
+    }
+
+    // convert a w*h RGB32 image to RGB888 with the requested kernel, returns the kernel actually used
+    LIBENV_API int convert_bgr32_to_rgb888(libenv_env *handle, int simd_level, char *dst, char *src, int w, int h) {
+        return bgr32_to_rgb888_with_level((SimdLevel)simd_level, dst, src, w, h);
+    }
 }
\ No newline at end of file
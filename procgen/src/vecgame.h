@@ -7,17 +7,85 @@ This implements the libenv interface and manages a vector of Game instances
 */
 
 #include <memory>
+#include <functional>
 #include <vector>
 #include <mutex>
 #include <string>
 #include <condition_variable>
 #include <thread>
-#include <list>
+#include <atomic>
+#include <cstdint>
+#include "index-queue.h"
+#include "spin-wait.h"
+#include "worker-pool.h"
 
 class VecOptions;
 class Game;
 
-class VecGame {
+enum SchedulerMode {
+    // games are handed to whichever thread is free through a shared queue
+    QueueScheduler = 0,
+    // each thread steps a fixed contiguous slice of games, which is cheaper when all games cost about the same
+    StaticScheduler = 1,
+    // each thread starts with a contiguous range of games that it steps in chunks, threads that run out of
+    // games steal half of what another thread has left
+    StealScheduler = 2,
+};
+
+// moving averages of how long it takes to step a game, the queue scheduler starts expensive games first
+struct alignas(64) GameCost {
+    // steps that didn't end an episode
+    double step_ns = 0.0;
+    // steps that ended an episode and reset the game, and the initial reset
+    double reset_ns = 0.0;
+    // all steps, games are ordered by this
+    double expected_ns = 0.0;
+};
+
+// games [begin, end) that a thread still has to step with the steal scheduler, packed into one word
+// so that the owner and thieves can both update it with a single compare and swap
+struct alignas(64) WorkRange {
+    std::atomic<uint64_t> bounds{0};
+};
+
+// a contiguous group of games that can be stepped independently of the other groups
+struct StepSlot {
+    int start;
+    int end;
+    // indices of games waiting to be stepped with the queue scheduler, when a game is pushed here
+    // ownership of the game object is transferred to the stepping thread that pops it until
+    // game->is_waiting_for_step is set to false
+    IndexQueue pending_games;
+    // number of work items (games or, for the static scheduler, slices) that haven't finished stepping yet
+    std::atomic<int> outstanding_steps{0};
+    // incremented to start a step with the static scheduler
+    std::atomic<uint64_t> step_generation{0};
+    // with the static scheduler, whether the calling thread still has to step its own slice
+    bool caller_slice_pending = false;
+    // the order the queue scheduler hands out the games in
+    std::vector<int> dispatch_order;
+    // with the steal scheduler, one range per thread and a last one for the calling thread
+    std::unique_ptr<WorkRange[]> ranges;
+    // number of games a thread takes from its own range at a time
+    std::atomic<int> chunk_size{1};
+
+    StepSlot(int _start, int _end) : start(_start), end(_end), pending_games(_end - _start) {
+        for (int e = start; e < end; e++) {
+            dispatch_order.push_back(e);
+        }
+    }
+};
+
+// where a game reads its action from and writes the results of a step to
+struct GameBuffers {
+    int32_t *action = nullptr;
+    std::vector<void *> obs;
+    std::vector<void *> info;
+    float *rew = nullptr;
+    uint8_t *first = nullptr;
+};
+
+class VecGame : public PoolClient {
   public:
     std::vector<struct libenv_tensortype> observation_types;
     std::vector<struct libenv_tensortype> action_types;
@@ -26,27 +94,95 @@ class VecGame {
     int num_envs;
     int num_joint_games;
     int num_actions;
+    int num_slots;
+    // number of games returned by recv(), 0 if send() and recv() aren't used
+    int batch_size;
     bool render_human;
+    SchedulerMode scheduler = QueueScheduler;
+    // cpu each stepping thread is pinned to, -1 if it isn't pinned
+    std::vector<int> worker_cpus;
 
     std::vector<std::shared_ptr<Game>> games;
+    // indexed like games, each entry is only updated by the thread that steps the game
+    std::vector<GameCost> game_costs;
 
     VecGame(int _nenvs, VecOptions opt_vec);
-    ~VecGame();
+    ~VecGame() override;
 
     void set_buffers(const std::vector<std::vector<void *>> &ac, const std::vector<std::vector<void *>> &ob, const std::vector<std::vector<void *>> &info, float *rew, uint8_t *first);
     void observe();
     void act();
     void wait_for_stepping_threads();
 
+    // double buffered stepping, each slot of games has its own buffers and is stepped on its own
+    void set_slot_buffers(int slot, const std::vector<std::vector<void *>> &ac, const std::vector<std::vector<void *>> &ob, const std::vector<std::vector<void *>> &info, float *rew, uint8_t *first);
+    // use_slot_buffers selects between the buffers from set_slot_buffers() and set_buffers()
+    void act_slot(int slot, bool use_slot_buffers);
+    void wait_for_slot(int slot);
+    // wait for a slot and make sure its buffers from set_slot_buffers() hold the latest results
+    void wait_for_slot_buffers(int slot);
+
+    // step individual games and collect whichever batch_size games finish first
+    void send(const int32_t *actions, const int *env_ids, int count);
+    int recv(int *env_ids);
+
+    bool run_pending_work() override;
+
   private:
-    // this mutex synchronizes access to pending_games and game->is_waiting_for_step
-    // when game->is_waiting_for_step is set to true
-    // ownership of game objects is transferred to the stepping thread until
-    // game->is_waiting_for_step is set to false
+    std::vector<std::unique_ptr<StepSlot>> slots;
+    // indexed like games, the games are pointed at one of these before each step
+    std::vector<GameBuffers> main_buffers;
+    std::vector<GameBuffers> slot_buffers;
+    // whether set_slot_buffers() has been called for each slot
+    std::vector<bool> has_slot_buffers;
+    // which buffers hold the results of the latest step of each game, a combination of MainBuffers and
+    // SlotBuffers, the other buffers are brought up to date when they are read
+    std::vector<uint8_t> current_buffers;
+    // number of threads still creating games in the constructor
+    std::atomic<int> outstanding_inits{0};
+    // games from send() waiting to be stepped, ownership passes to the stepping threads like pending_games
+    IndexQueue sent_games;
+    // games from send() that have finished stepping but haven't been returned by recv()
+    IndexQueue completed_games;
+    std::atomic<int> num_completed{0};
+    // number of games from send() that haven't finished stepping yet
+    std::atomic<int> outstanding_sends{0};
+    // whether a game has been passed to send() and not returned by recv() yet, only used by the calling thread
+    std::vector<bool> game_sent;
+    // this mutex is only used to sleep and wake up threads
     std::mutex stepping_thread_mutex;
-    std::list<std::shared_ptr<Game>> pending_games;
     std::condition_variable pending_games_added;
     std::condition_variable pending_game_complete;
     std::vector<std::thread> threads;
-    bool time_to_die = false;
+    // set when the games are stepped by the process wide pool instead of threads of our own
+    WorkerPool *pool = nullptr;
+    // the slot that pool threads look at first
+    std::atomic<int> pool_slot{0};
+    std::atomic<bool> time_to_die{false};
+    // see SpinWait::configure()
+    int spin_wait_us = -1;
+    SpinWait caller_spin_wait;
+
+    // only set while the constructor creates games on the stepping threads
+    std::function<void(int)> init_slice;
+
+    void worker_main(int thread_idx);
+    void stepping_worker();
+    void static_stepping_worker(int thread_idx);
+    void step_game(const std::shared_ptr<Game> &game);
+    bool has_pending_games();
+    bool pop_pending_game(int first_slot, int *slot, int *env_idx);
+    bool step_pending_game(int *slot);
+    void get_slice(int slot, int slice_idx, int *start, int *end);
+    void step_slice(int slot, int slice_idx);
+    void step_range(int slot, int worker_idx);
+    int choose_chunk_size(int slot);
+    void finish_work_item(std::atomic<int> &outstanding, int count = 1);
+    void finish_sent_game(int env_idx);
+    void use_buffers(int env_idx, bool use_slot_buffers);
+    void copy_results(int env_idx, const GameBuffers &src, const GameBuffers &dst);
+    void notify_stepping_threads();
+    void start_stepping(int slot);
+    template <typename F>
+    void wait_until(SpinWait &spin_wait, std::condition_variable &cv, F done);
 };
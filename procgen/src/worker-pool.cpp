@@ -0,0 +1,150 @@
+#include "worker-pool.h"
+#include "spin-wait.h"
+#include "cpp-utils.h"
+#include <algorithm>
+
+WorkerPool &WorkerPool::global() {
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        time_to_die = true;
+    }
+    work_added.notify_all();
+
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+bool WorkerPool::start(int num_threads) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (started) {
+        return num_threads < 0 || num_threads == (int)(threads.size());
+    }
+
+    if (num_threads < 0) {
+        num_threads = std::max((int)(std::thread::hardware_concurrency()), 1);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back(&WorkerPool::worker_main, this);
+    }
+    started = true;
+    return true;
+}
+
+int WorkerPool::num_threads() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return (int)(threads.size());
+}
+
+void WorkerPool::add_client(PoolClient *client, int priority) {
+    auto entry = std::make_shared<ClientEntry>();
+    entry->client = client;
+    entry->priority = priority;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // insert after the existing clients with the same priority
+    auto pos = std::find_if(clients.begin(), clients.end(), [&](const std::shared_ptr<ClientEntry> &e) { return e->priority < priority; });
+    clients.insert(pos, entry);
+    clients_version.fetch_add(1, std::memory_order_release);
+}
+
+void WorkerPool::remove_client(PoolClient *client) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto pos = std::find_if(clients.begin(), clients.end(), [&](const std::shared_ptr<ClientEntry> &e) { return e->client == client; });
+    fassert(pos != clients.end());
+    auto entry = *pos;
+    clients.erase(pos);
+    clients_version.fetch_add(1, std::memory_order_release);
+
+    // threads may still find the entry in their copies of the list, they increment active before checking
+    // removed, so either they see it's removed or we see them as active
+    entry->removed.store(true);
+    client_idle.wait(lock, [&]() { return entry->active.load() == 0; });
+}
+
+void WorkerPool::notify_work_added() {
+    work_generation.fetch_add(1, std::memory_order_release);
+    {
+        // taking the lock orders this notification after any worker that is about to wait has checked
+        // for work
+        std::unique_lock<std::mutex> lock(mutex);
+    }
+    work_added.notify_all();
+}
+
+// try the clients in priority order and run one piece of work for the first one that has any
+bool WorkerPool::run_one(WorkerState &state) {
+    if (state.clients_version != clients_version.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        state.clients = clients;
+        state.clients_version = clients_version.load(std::memory_order_relaxed);
+    }
+
+    const auto &list = state.clients;
+    auto &order = state.order;
+    uint64_t turn = next_turn.fetch_add(1, std::memory_order_relaxed);
+    order.clear();
+    size_t group_start = 0;
+    while (group_start < list.size()) {
+        size_t group_end = group_start;
+        while (group_end < list.size() && list[group_end]->priority == list[group_start]->priority) {
+            group_end++;
+        }
+        size_t group_size = group_end - group_start;
+        for (size_t i = 0; i < group_size; i++) {
+            order.push_back(list[group_start + (turn + i) % group_size]);
+        }
+        group_start = group_end;
+    }
+
+    for (const auto &entry : order) {
+        entry->active.fetch_add(1);
+        bool ran = false;
+        if (!entry->removed.load()) {
+            ran = entry->client->run_pending_work();
+        }
+
+        if (entry->active.fetch_sub(1) == 1 && entry->removed.load()) {
+            // remove_client() checks active with the mutex held, so take it to not notify in between
+            std::unique_lock<std::mutex> lock(mutex);
+            client_idle.notify_all();
+        }
+
+        if (ran) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkerPool::worker_main() {
+    WorkerState state;
+    SpinWait spin_wait;
+    // with more threads than cores, a spinning thread takes time away from the one it waits for
+    spin_wait.configure(num_threads() + 1 > (int)(std::thread::hardware_concurrency()) ? 0 : -1);
+
+    while (1) {
+        // read the generation first, so that work added while we look is noticed below
+        uint64_t generation = work_generation.load(std::memory_order_acquire);
+        if (run_one(state)) {
+            continue;
+        }
+
+        auto done = [&]() { return time_to_die.load() || work_generation.load(std::memory_order_acquire) != generation; };
+        if (!spin_wait.spin(done)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_added.wait(lock, done);
+            spin_wait.finish_blocking();
+        }
+
+        if (time_to_die.load()) {
+            return;
+        }
+    }
+}
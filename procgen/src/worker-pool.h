@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+
+Process wide pool of stepping threads shared by every VecGame created with shared_pool
+
+Without it each VecGame starts its own threads, so a process with a few environments ends up with many
+more threads than cores. The pool threads are created by the first environment that uses the pool and are
+reused by every environment created afterwards, the size of the pool is fixed at that point. Clients with a higher priority are always served first, clients
+with the same priority take turns so that one busy environment can't starve the others.
+
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PoolClient {
+  public:
+    virtual ~PoolClient() = default;
+
+    // do one piece of work if there is any, returns false if there was nothing to do
+    virtual bool run_pending_work() = 0;
+};
+
+class WorkerPool {
+  public:
+    static WorkerPool &global();
+
+    ~WorkerPool();
+
+    // start the pool with num_threads threads, or one per core if num_threads is -1, the first time this is
+    // called, returns false if the pool was already started with a different number of threads
+    bool start(int num_threads);
+    int num_threads();
+
+    void add_client(PoolClient *client, int priority);
+    // returns once no thread is working for the client anymore
+    void remove_client(PoolClient *client);
+
+    // call after a client adds work so that sleeping threads look for it
+    void notify_work_added();
+
+  private:
+    struct ClientEntry {
+        PoolClient *client;
+        int priority;
+        // number of threads currently running work for this client
+        std::atomic<int> active{0};
+        std::atomic<bool> removed{false};
+    };
+
+    // each thread works from its own copy of the client list, so that finding work doesn't take the mutex
+    struct WorkerState {
+        std::vector<std::shared_ptr<ClientEntry>> clients;
+        uint64_t clients_version = 0;
+        std::vector<std::shared_ptr<ClientEntry>> order;
+    };
+
+    // the mutex protects threads and clients, and is used to wait for the condition variables
+    std::mutex mutex;
+    std::condition_variable work_added;
+    std::condition_variable client_idle;
+    // sorted by decreasing priority
+    std::vector<std::shared_ptr<ClientEntry>> clients;
+    // incremented every time clients changes so that threads know to copy it again, starts at 1 so that it
+    // never matches a fresh WorkerState
+    std::atomic<uint64_t> clients_version{1};
+    // rotates which client of the same priority is tried first
+    std::atomic<uint64_t> next_turn{0};
+    // incremented every time work is added so that idle threads can tell whether to look again
+    std::atomic<uint64_t> work_generation{0};
+    std::vector<std::thread> threads;
+    bool started = false;
+    std::atomic<bool> time_to_die{false};
+
+    void worker_main();
+    bool run_one(WorkerState &state);
+};